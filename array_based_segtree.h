@@ -5,21 +5,49 @@
 
 #include <stdlib.h>
 
+#include "segtree_layout.h"
+#include "segtree_parallel.h"
 #include "updatable_segtree.h"
 
-#define ArrayBasedSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator>
-#define ArrayBasedSegtreeTmpl ArrayBasedSegtree<Item, Aggregate, Aggregator>
-#define UpdatableSegtreeTmpl UpdatableSegtree<Item, Aggregate, Aggregator>
-#define SegtreeTmpl Segtree<Aggregate, Aggregator>
+#define ArrayBasedSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Layout, typename Lazy, typename Tracking>
+#define ArrayBasedSegtreeTmpl ArrayBasedSegtree<Item, Aggregate, Aggregator, Layout, Lazy, Tracking>
+#define ArrayBasedSegtreeBaseTmpl UpdatableSegtree<ArrayBasedSegtreeTmpl, Item, Aggregate, Aggregator, Lazy>
 
 namespace gokul2411s {
-    ArrayBasedSegtreeTmplParamSpec
-        class ArrayBasedSegtree : public UpdatableSegtreeTmpl {
+    /**
+     * The default Tracking of ArrayBasedSegtree, which ignores the changes to the pool, so that
+     * updates pay nothing for them. A Tracking is told the byte range of the pool that it
+     * spans (reset), and every byte range that an update changes (mark).
+     */
+    struct NoPageTracking {
+        void reset(size_t) {}
+
+        void mark(size_t, size_t) {}
+    };
+
+    /**
+     * The standard array based segment tree. The Layout (see segtree_layout.h) decides where
+     * each node is placed in the array; the default is the breadth-first heap order. The Lazy
+     * objects (see segtree_lazy.h) decide the kind of range update; the default overwrites or
+     * increments. The Tracking is told which parts of the array updates change; the default
+     * ignores them. SavableArrayBasedSegtree (see array_based_segtree_file.h) tracks them to
+     * save the tree to a file and keep it up to date with checkpoints.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Layout = HeapLayout, typename Lazy = UpdateLazy<Item>, typename Tracking = NoPageTracking>
+        class ArrayBasedSegtree : public ArrayBasedSegtreeBaseTmpl {
+            friend class Segtree<ArrayBasedSegtreeTmpl, Aggregate, Aggregator, Lazy>;
+            friend class ArrayBasedSegtreeBaseTmpl;
+
             public:
-                template<typename Iterator> ArrayBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+                /**
+                 * Builds the segment tree over the given iterable range. With more than one thread,
+                 * the top levels of the build hand their left subtree to a new thread; the tree
+                 * built is identical to the one built on a single thread.
+                 */
+                template<typename Iterator> ArrayBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator(), size_t num_threads = 1);
                 ~ArrayBasedSegtree();
             protected:
-                using typename UpdatableSegtreeTmpl::UpdatableNode;
+                using typename ArrayBasedSegtreeBaseTmpl::UpdatableNode;
                 struct WrappedNode : public UpdatableNode {
                     size_t index;
 
@@ -27,52 +55,80 @@ namespace gokul2411s {
                         UpdatableNode(val, start, end), index(indexx) {}
                 };
 
+                Layout layout_;
                 size_t tree_size_;
                 char * pool_;
+                Tracking tracking_;
+
+                /**
+                 * Constructs an empty segment tree without a pool, for a derived class to fill.
+                 */
+                ArrayBasedSegtree(Aggregator const & aggregator)
+                    : ArrayBasedSegtreeBaseTmpl(aggregator), layout_(1), tree_size_(0), pool_(NULL) {}
+
+                /**
+                 * Tells the Tracking about the bytes of the given node, which an update changes.
+                 */
+                void mark_dirty(UpdatableNode * n) {
+                    tracking_.mark((char *)n - pool_, sizeof(WrappedNode));
+                }
 
                 /**
-                 * Gets the size of the array required to represent the segment tree. This computation
-                 * is required since the segment tree is not truly a complete tree, but rather an
-                 * almost complete tree.
+                 * Gets the number of levels of the complete tree required to represent the segment
+                 * tree. This computation is required since the segment tree is not truly a complete
+                 * tree, but rather an almost complete tree.
                  */
-                size_t tree_size(size_t num_items) const {
-                    size_t psz = 1;
+                static size_t tree_levels(size_t num_items) {
+                    size_t psz = 1, levels = 1;
                     while (true) {
                         if (num_items <= psz) {
                             break;
                         }
                         psz *= 2;
+                        levels++;
                     }
 
-                    return 2 * psz - 1;
+                    return levels;
                 }
 
                 /**
                  * Gets the index of the left child of the node placed at index.
                  */
                 size_t get_lindex(size_t index) const {
-                    return 2 * index + 1;
+                    return layout_.child(index, 0);
                 }
 
                 /**
                  * Get the index of the right child of the node placed at index.
                  */
                 size_t get_rindex(size_t index) const {
-                    return 2 * index + 2;
+                    return layout_.child(index, 1);
                 }
 
                 /**
                  * Recursively builds the segment tree under the node representing the
-                 * closed range [l, r].
+                 * closed range [l, r]. The top fork_levels levels build their left subtree
+                 * on a new thread.
                  */
-                template<typename Iterator> WrappedNode * build(Iterator begin, Iterator end, size_t l, size_t r, size_t index = 0) {
+                template<typename Iterator> WrappedNode * build(Iterator begin, Iterator end, size_t l, size_t r, size_t index, size_t fork_levels) {
                     Aggregate val;
                     if (l == r) {
                         val = *(begin + l);
                     } else {
                         size_t mid = l + (r - l) / 2;
-                        WrappedNode * l_node = build(begin, end, l, mid, get_lindex(index));
-                        WrappedNode * r_node = build(begin, end, mid + 1, r, get_rindex(index));
+                        WrappedNode * l_node = NULL, * r_node = NULL;
+                        if (fork_levels > 0 && r - l + 1 >= PARALLEL_BUILD_GRAIN) {
+                            // the subtrees occupy disjoint slots of the pool, so they can be
+                            // built concurrently.
+                            std::thread l_builder([&]() {
+                                l_node = build(begin, end, l, mid, get_lindex(index), fork_levels - 1);
+                            });
+                            r_node = build(begin, end, mid + 1, r, get_rindex(index), fork_levels - 1);
+                            l_builder.join();
+                        } else {
+                            l_node = build(begin, end, l, mid, get_lindex(index), 0);
+                            r_node = build(begin, end, mid + 1, r, get_rindex(index), 0);
+                        }
                         val = this->aggregate(l_node->val, r_node->val);
                     }
                     return new (get_node(index)) WrappedNode(val, l, r, index);
@@ -81,34 +137,33 @@ namespace gokul2411s {
                 /**
                  * Gets the node placed at the index.
                  */
-                WrappedNode * get_node(size_t index) {
+                WrappedNode * get_node(size_t index) const {
                     return (WrappedNode*)pool_ + index;
                 }
                 
-                using typename SegtreeTmpl::Node;
-                Node * get_left_child(Node * n) {
-                    if (n->end > n->start) {
-                        return get_node(get_lindex(static_cast<WrappedNode*>(n)->index));
-                    } else {
-                        return NULL;
-                    }
+                using typename ArrayBasedSegtreeBaseTmpl::Node;
+                /**
+                 * Gets the left child of the given non-trivial node.
+                 */
+                Node * get_left_child(Node const * n) const {
+                    return get_node(get_lindex(static_cast<WrappedNode const *>(n)->index));
                 }
 
-                Node * get_right_child(Node * n) {
-                    if (n->end > n->start) {
-                        return get_node(get_rindex(static_cast<WrappedNode*>(n)->index));
-                    } else {
-                        return NULL;
-                    }
+                /**
+                 * Gets the right child of the given non-trivial node.
+                 */
+                Node * get_right_child(Node const * n) const {
+                    return get_node(get_rindex(static_cast<WrappedNode const *>(n)->index));
                 }
         };
 
     ArrayBasedSegtreeTmplParamSpec
-        template<typename Iterator> ArrayBasedSegtreeTmpl::ArrayBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator)
-        : UpdatableSegtreeTmpl(aggregator), tree_size_(tree_size(end - begin)) {
+        template<typename Iterator> ArrayBasedSegtreeTmpl::ArrayBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator, size_t num_threads)
+        : ArrayBasedSegtreeBaseTmpl(aggregator), layout_(tree_levels(end - begin)), tree_size_(layout_.size()) {
             size_t l = 0, r = end - begin - 1;
             pool_ = (char *)calloc(tree_size_, sizeof(WrappedNode));
-            this->root_ = build(begin, end, l, r);
+            tracking_.reset(tree_size_ * sizeof(WrappedNode));
+            this->root_ = build(begin, end, l, r, layout_.root(), get_fork_levels(num_threads, 2));
         }
 
     ArrayBasedSegtreeTmplParamSpec
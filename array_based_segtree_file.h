@@ -0,0 +1,443 @@
+#ifndef ARRAY_BASED_SEGTREE_FILE_H_
+#define ARRAY_BASED_SEGTREE_FILE_H_
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "array_based_segtree.h"
+
+#define SavableArrayBasedSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Layout, typename Lazy>
+#define SavableArrayBasedSegtreeTmpl SavableArrayBasedSegtree<Item, Aggregate, Aggregator, Layout, Lazy>
+#define SavableArrayBasedSegtreeBaseTmpl ArrayBasedSegtree<Item, Aggregate, Aggregator, Layout, Lazy, DirtyPageTracking>
+
+namespace gokul2411s {
+    /**
+     * A Tracking for ArrayBasedSegtree (see NoPageTracking), which keeps one bit for every page
+     * of DIRTY_PAGE_SIZE bytes of the pool, set once an update changes the page.
+     */
+    class DirtyPageTracking {
+        public:
+            static const size_t DIRTY_PAGE_SIZE = 4096;
+
+            DirtyPageTracking() : num_bytes_(0) {}
+
+            void reset(size_t num_bytes) {
+                num_bytes_ = num_bytes;
+                clear();
+            }
+
+            void mark(size_t offset, size_t num_bytes) {
+                size_t first = offset / DIRTY_PAGE_SIZE, last = (offset + num_bytes - 1) / DIRTY_PAGE_SIZE;
+                for (size_t page = first; page <= last; page++) {
+                    dirty_pages_[page / 64] |= uint64_t(1) << (page % 64);
+                }
+            }
+
+            /**
+             * Marks every page as unchanged.
+             */
+            void clear() {
+                dirty_pages_.assign((get_num_pages() + 63) / 64, 0);
+            }
+
+            /**
+             * Gets the number of pages that the pool spans.
+             */
+            size_t get_num_pages() const {
+                return (num_bytes_ + DIRTY_PAGE_SIZE - 1) / DIRTY_PAGE_SIZE;
+            }
+
+            /**
+             * Gets the number of bytes of the pool in the given page, which is less than
+             * DIRTY_PAGE_SIZE for the last page only.
+             */
+            size_t get_page_bytes(size_t page) const {
+                size_t start = page * DIRTY_PAGE_SIZE;
+                return num_bytes_ - start < DIRTY_PAGE_SIZE ? num_bytes_ - start : DIRTY_PAGE_SIZE;
+            }
+
+            bool is_dirty(size_t page) const {
+                return (dirty_pages_[page / 64] >> (page % 64)) & 1;
+            }
+
+            /**
+             * Checks if any page has changed.
+             */
+            bool any_dirty() const {
+                for (size_t i = 0; i < dirty_pages_.size(); i++) {
+                    if (dirty_pages_[i] != 0) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+        protected:
+            size_t num_bytes_;
+            std::vector<uint64_t> dirty_pages_;
+    };
+
+    /**
+     * An ArrayBasedSegtree which can also be saved to a file, opened from one, and kept up to
+     * date on disk with delta checkpoints. This needs a POSIX system, and nodes that are
+     * trivially copyable (e.g. plain numbers as Item and Aggregate).
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Layout = HeapLayout, typename Lazy = UpdateLazy<Item> >
+        class SavableArrayBasedSegtree : public SavableArrayBasedSegtreeBaseTmpl {
+            public:
+                /**
+                 * Builds the segment tree over the given iterable range, as ArrayBasedSegtree
+                 * does.
+                 */
+                template<typename Iterator> SavableArrayBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator(), size_t num_threads = 1)
+                    : SavableArrayBasedSegtreeBaseTmpl(begin, end, aggregator, num_threads), mapping_(NULL), mapping_size_(0), sequence_(0), lineage_(new_lineage()) {}
+
+                /**
+                 * Opens the segment tree saved at the given path, which must have been saved by a
+                 * segment tree of the same type. The nodes are not read, but mapped into memory
+                 * privately, so that queries page them in from the file as needed, and updates
+                 * copy the pages they change instead of writing to the file. Processes which open
+                 * the same file share the pages that they have not changed.
+                 *
+                 * Throws std::runtime_error if the file cannot be mapped, or is not a segment tree
+                 * of this type saved on a machine with the same byte order.
+                 */
+                SavableArrayBasedSegtree(std::string const & path, Aggregator const & aggregator = Aggregator());
+                ~SavableArrayBasedSegtree();
+
+                /**
+                 * Saves the segment tree, with any updates applied, at the given path. The file
+                 * holds a header followed by the nodes exactly as they lie in memory.
+                 *
+                 * Throws std::runtime_error if the file cannot be written.
+                 */
+                void save(std::string const & path) const;
+
+                /**
+                 * Writes a delta checkpoint at the given path, holding only the pages of nodes
+                 * (DIRTY_PAGE_SIZE bytes each) that updates changed since the previous
+                 * checkpoint, or since the segment tree was built or opened. Checkpoints are
+                 * numbered in sequence, and a file saved in between records the number of the
+                 * last one, so that the file followed by every later checkpoint, in order,
+                 * gives back the segment tree (see replay). Every checkpoint also records a
+                 * random id of the state it applies on and one of the state it leaves, so that
+                 * it is refused by segment trees with another history.
+                 *
+                 * Throws std::runtime_error if the file cannot be written.
+                 */
+                void checkpoint(std::string const & path);
+
+                /**
+                 * Applies the delta checkpoint at the given path, which must be the one numbered
+                 * right after the last checkpoint applied to (or recorded in the file of) this
+                 * segment tree, and must have been taken from the same state, by the segment tree
+                 * this one was saved from or by one opened from the same file. The segment tree
+                 * must not have been updated since it was opened or last checkpointed, since the
+                 * checkpoint would then be mixed with those updates.
+                 *
+                 * Throws std::runtime_error if the file cannot be read, or does not fit.
+                 */
+                void replay(std::string const & path);
+            protected:
+                typedef typename SavableArrayBasedSegtreeBaseTmpl::WrappedNode WrappedNode;
+
+                /**
+                 * The header of a saved segment tree, padded to a cache line so that the nodes
+                 * after it stay aligned.
+                 */
+                struct FileHeader {
+                    char magic[8];
+                    uint32_t format_version;
+                    uint32_t byte_order;
+                    uint64_t node_size;
+                    uint64_t num_items;
+                    uint64_t tree_size;
+                    uint64_t sequence;
+                    uint64_t lineage;
+                    char padding[8];
+                };
+
+                /**
+                 * The header of a delta checkpoint, followed by num_pages pages, each preceded by
+                 * its number. The last page of the pool may be shorter. base_lineage is the
+                 * lineage of the segment tree that the checkpoint applies on, and lineage the one
+                 * that it leaves.
+                 */
+                struct CheckpointHeader {
+                    char magic[8];
+                    uint32_t format_version;
+                    uint32_t byte_order;
+                    uint64_t node_size;
+                    uint64_t tree_size;
+                    uint64_t sequence;
+                    uint64_t num_pages;
+                    uint64_t base_lineage;
+                    uint64_t lineage;
+                };
+
+                static const uint32_t FILE_FORMAT_VERSION = 2;
+
+                // written in the byte order of the machine, so that it reads back differently
+                // on a machine with another byte order.
+                static const uint32_t FILE_BYTE_ORDER = 0x01020304;
+
+                // the file mapping holding the pool, or NULL if the pool was allocated.
+                void * mapping_;
+                size_t mapping_size_;
+
+                // the number of the last checkpoint, and a random id of the state of the
+                // segment tree as of that checkpoint (or as built), which changes with every
+                // checkpoint.
+                uint64_t sequence_;
+                uint64_t lineage_;
+
+                /**
+                 * Draws a random id for a new state of a segment tree.
+                 */
+                static uint64_t new_lineage() {
+                    std::random_device device;
+                    return (uint64_t(device()) << 32) ^ device();
+                }
+
+                static char const * get_file_magic() {
+                    return "SEGTREE";
+                }
+
+                static char const * get_checkpoint_magic() {
+                    return "SEGDELTA";
+                }
+
+                static void throw_file_error(char const * what, std::string const & path, int error) {
+                    std::string message = std::string(what) + " " + path;
+                    if (error != 0) {
+                        message += ": " + std::string(strerror(error));
+                    }
+                    throw std::runtime_error(message);
+                }
+            private:
+                SavableArrayBasedSegtree(SavableArrayBasedSegtree const &);
+                SavableArrayBasedSegtree & operator = (SavableArrayBasedSegtree const &);
+        };
+
+    SavableArrayBasedSegtreeTmplParamSpec
+        SavableArrayBasedSegtreeTmpl::SavableArrayBasedSegtree(std::string const & path, Aggregator const & aggregator)
+        : SavableArrayBasedSegtreeBaseTmpl(aggregator), mapping_(NULL), mapping_size_(0), sequence_(0), lineage_(0) {
+            static_assert(std::is_trivially_copyable<WrappedNode>::value, "only segment trees with trivially copyable nodes can be opened from a file");
+
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw_file_error("cannot open", path, errno);
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                int error = errno;
+                close(fd);
+                throw_file_error("cannot stat", path, error);
+            }
+
+            if ((size_t)st.st_size < sizeof(FileHeader)) {
+                close(fd);
+                throw_file_error("not a segment tree:", path, 0);
+            }
+
+            // the mapping stays valid after the file is closed.
+            void * mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            int error = errno;
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                throw_file_error("cannot map", path, error);
+            }
+
+            // the header is untrusted, so its sizes are bounded by the size of the file before
+            // anything is computed from them.
+            FileHeader const * header = (FileHeader const *)mapping;
+            size_t max_nodes = ((size_t)st.st_size - sizeof(FileHeader)) / sizeof(WrappedNode);
+            bool valid = memcmp(header->magic, get_file_magic(), sizeof(header->magic)) == 0 &&
+                header->format_version == FILE_FORMAT_VERSION &&
+                header->byte_order == FILE_BYTE_ORDER &&
+                header->node_size == sizeof(WrappedNode) &&
+                header->num_items != 0 &&
+                header->num_items <= max_nodes;
+
+            Layout layout(1);
+            if (valid) {
+                // with tree_size within max_nodes, its size in bytes cannot overflow.
+                layout = Layout(this->tree_levels(header->num_items));
+                valid = header->tree_size == layout.size() &&
+                    header->tree_size <= max_nodes &&
+                    (size_t)st.st_size == sizeof(FileHeader) + header->tree_size * sizeof(WrappedNode);
+            }
+
+            if (!valid) {
+                munmap(mapping, st.st_size);
+                throw_file_error("not a segment tree of this type:", path, 0);
+            }
+
+            mapping_ = mapping;
+            mapping_size_ = st.st_size;
+            this->layout_ = layout;
+            this->tree_size_ = header->tree_size;
+            this->pool_ = (char *)mapping + sizeof(FileHeader);
+            this->tracking_.reset(this->tree_size_ * sizeof(WrappedNode));
+            sequence_ = header->sequence;
+            lineage_ = header->lineage;
+            this->root_ = this->get_node(this->layout_.root());
+        }
+
+    SavableArrayBasedSegtreeTmplParamSpec
+        SavableArrayBasedSegtreeTmpl::~SavableArrayBasedSegtree() {
+            if (mapping_ != NULL) {
+                // the pool belongs to the mapping, so it is taken away from ArrayBasedSegtree
+                // before that frees it.
+                munmap(mapping_, mapping_size_);
+                this->pool_ = NULL;
+                this->tree_size_ = 0;
+            }
+        }
+
+    SavableArrayBasedSegtreeTmplParamSpec
+        void SavableArrayBasedSegtreeTmpl::save(std::string const & path) const {
+            static_assert(std::is_trivially_copyable<WrappedNode>::value, "only segment trees with trivially copyable nodes can be saved");
+
+            FileHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, get_file_magic(), sizeof(header.magic));
+            header.format_version = FILE_FORMAT_VERSION;
+            header.byte_order = FILE_BYTE_ORDER;
+            header.node_size = sizeof(WrappedNode);
+            header.num_items = this->root_->end + 1;
+            header.tree_size = this->tree_size_;
+            header.sequence = sequence_;
+            header.lineage = lineage_;
+
+            FILE * file = fopen(path.c_str(), "wb");
+            if (file == NULL) {
+                throw_file_error("cannot create", path, errno);
+            }
+
+            bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(this->pool_, sizeof(WrappedNode), this->tree_size_, file) == this->tree_size_;
+            int error = errno;
+            if (fclose(file) != 0 && written) {
+                written = false;
+                error = errno;
+            }
+
+            if (!written) {
+                throw_file_error("cannot write", path, error);
+            }
+        }
+
+    SavableArrayBasedSegtreeTmplParamSpec
+        void SavableArrayBasedSegtreeTmpl::checkpoint(std::string const & path) {
+            static_assert(std::is_trivially_copyable<WrappedNode>::value, "only segment trees with trivially copyable nodes can be checkpointed");
+
+            CheckpointHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, get_checkpoint_magic(), sizeof(header.magic));
+            header.format_version = FILE_FORMAT_VERSION;
+            header.byte_order = FILE_BYTE_ORDER;
+            header.node_size = sizeof(WrappedNode);
+            header.tree_size = this->tree_size_;
+            header.sequence = sequence_ + 1;
+            header.base_lineage = lineage_;
+            header.lineage = new_lineage();
+            DirtyPageTracking const & tracking = this->tracking_;
+            for (size_t page = 0; page < tracking.get_num_pages(); page++) {
+                header.num_pages += tracking.is_dirty(page);
+            }
+
+            FILE * file = fopen(path.c_str(), "wb");
+            if (file == NULL) {
+                throw_file_error("cannot create", path, errno);
+            }
+
+            bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+            for (uint64_t page = 0; page < tracking.get_num_pages() && written; page++) {
+                if (tracking.is_dirty(page)) {
+                    written = fwrite(&page, sizeof(page), 1, file) == 1 &&
+                        fwrite(this->pool_ + page * DirtyPageTracking::DIRTY_PAGE_SIZE, tracking.get_page_bytes(page), 1, file) == 1;
+                }
+            }
+            int error = errno;
+            if (fclose(file) != 0 && written) {
+                written = false;
+                error = errno;
+            }
+
+            if (!written) {
+                throw_file_error("cannot write", path, error);
+            }
+
+            // the pages stay dirty unless the checkpoint was written in full.
+            this->tracking_.clear();
+            sequence_++;
+            lineage_ = header.lineage;
+        }
+
+    SavableArrayBasedSegtreeTmplParamSpec
+        void SavableArrayBasedSegtreeTmpl::replay(std::string const & path) {
+            static_assert(std::is_trivially_copyable<WrappedNode>::value, "only segment trees with trivially copyable nodes can be checkpointed");
+
+            FILE * file = fopen(path.c_str(), "rb");
+            if (file == NULL) {
+                throw_file_error("cannot open", path, errno);
+            }
+
+            CheckpointHeader header;
+            if (fread(&header, sizeof(header), 1, file) != 1 ||
+                    memcmp(header.magic, get_checkpoint_magic(), sizeof(header.magic)) != 0 ||
+                    header.format_version != FILE_FORMAT_VERSION ||
+                    header.byte_order != FILE_BYTE_ORDER ||
+                    header.node_size != sizeof(WrappedNode) ||
+                    header.tree_size != this->tree_size_) {
+                fclose(file);
+                throw_file_error("not a checkpoint of this segment tree:", path, 0);
+            }
+
+            if (header.sequence != sequence_ + 1) {
+                fclose(file);
+                throw_file_error("checkpoint out of sequence:", path, 0);
+            }
+
+            if (header.base_lineage != lineage_) {
+                fclose(file);
+                throw_file_error("checkpoint of another segment tree:", path, 0);
+            }
+
+            if (this->tracking_.any_dirty()) {
+                fclose(file);
+                throw_file_error("cannot replay onto a segment tree updated since its last checkpoint:", path, 0);
+            }
+
+            // the pages are read in place, so a failure part way leaves the segment tree
+            // partially replayed.
+            for (uint64_t k = 0; k < header.num_pages; k++) {
+                uint64_t page;
+                if (fread(&page, sizeof(page), 1, file) != 1 || page >= this->tracking_.get_num_pages() ||
+                        fread(this->pool_ + page * DirtyPageTracking::DIRTY_PAGE_SIZE, this->tracking_.get_page_bytes(page), 1, file) != 1) {
+                    fclose(file);
+                    throw_file_error("truncated checkpoint:", path, 0);
+                }
+            }
+
+            fclose(file);
+            sequence_ = header.sequence;
+            lineage_ = header.lineage;
+        }
+}
+
+#endif
@@ -0,0 +1,294 @@
+#ifndef ARRAY_BASED_SEGTREE_ND_H_
+#define ARRAY_BASED_SEGTREE_ND_H_
+
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "segtree_parallel.h"
+#include "updatable_segtree_nd.h"
+
+#define ArrayBasedSegtreeNdTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
+#define ArrayBasedSegtreeNdTmpl ArrayBasedSegtreeNd<Item, Aggregate, Aggregator, Point, NumDims>
+#define ArrayBasedSegtreeNdBaseTmpl UpdatableSegtreeNd<ArrayBasedSegtreeNdTmpl, Item, Aggregate, Aggregator, Point, NumDims>
+
+namespace gokul2411s {
+    /**
+     * The array based counterpart of NodeBasedSegtreeNd, with the same shape of tree and the
+     * same methods. All nodes are placed in one contiguous array, and the children of a node
+     * are found by computing their index instead of following pointers.
+     *
+     * The array holds the levels of the tree one after another. Going down a level, a dimension
+     * is split in two as long as some range of that level is still wider than one element in it,
+     * and the position of a child within its level is the position of its parent followed by one
+     * bit for every dimension split at that level. The positions within a level are thus the
+     * per-dimension positions with their bits interleaved (Z-order or Morton order), so that
+     * nodes which are close in space are close in the array too. Slots of children that a node
+     * does not have (because its range is one element wide in a dimension that others at its
+     * level still split) are left unused.
+     *
+     * A node keeps its number of children (up to 2^NumDims) in a byte, so NumDims must be less
+     * than 8.
+     */
+    ArrayBasedSegtreeNdTmplParamSpec
+        class ArrayBasedSegtreeNd : public ArrayBasedSegtreeNdBaseTmpl {
+            friend class SegtreeNd<ArrayBasedSegtreeNdTmpl, Aggregate, Aggregator, Point, NumDims>;
+            friend class ArrayBasedSegtreeNdBaseTmpl;
+
+            // a node has up to 2^NumDims children, which num_children below must hold.
+            static_assert(NumDims < 8, "ArrayBasedSegtreeNd supports fewer than 8 dimensions");
+
+            public:
+                /**
+                 * Builds the segment tree over the closed range [l, r] of the matrix. With more than
+                 * one thread, the top levels of the build hand each of their children to a separate
+                 * thread; the tree built is identical to the one built on a single thread.
+                 */
+                template<typename Matrix> ArrayBasedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator = Aggregator(), size_t num_threads = 1);
+                ~ArrayBasedSegtreeNd();
+            protected:
+                using ArrayBasedSegtreeNdBaseTmpl::NUM_CHILDREN;
+
+                using typename ArrayBasedSegtreeNdBaseTmpl::UpdatableNode;
+                struct WrappedNode : public UpdatableNode {
+                    // small enough to fit in the padding at the end of UpdatableNode. the index
+                    // of the node is not kept, since it follows from the address of the node.
+                    unsigned char level;
+                    unsigned char num_children;
+
+                    WrappedNode(Aggregate const & val, Point const & start, Point const & end, size_t levell, size_t num_childrenn) :
+                        UpdatableNode(val, start, end), level(levell), num_children(num_childrenn) {}
+                };
+
+                // the number of levels below the root that split each dimension.
+                size_t split_levels_[NumDims];
+
+                // the index of the first slot of each level, and the number of bits that a child
+                // adds to the position of its parent below each level.
+                std::vector<size_t> level_offsets_;
+                std::vector<size_t> level_digit_bits_;
+
+                size_t tree_size_;
+                char * pool_;
+
+                /**
+                 * Gets the number of levels that halving a range of the given number of elements
+                 * takes to reach single elements.
+                 */
+                static size_t get_split_levels(size_t num_items) {
+                    size_t psz = 1, levels = 0;
+                    while (num_items > psz) {
+                        psz *= 2;
+                        levels++;
+                    }
+                    return levels;
+                }
+
+                /**
+                 * Gets the number of children of the node representing the closed range [l, r].
+                 */
+                static size_t get_num_children(Point const & l, Point const & r) {
+                    if (l == r) {
+                        return 0;
+                    }
+
+                    size_t ret = 1;
+                    for (size_t dim = 0; dim < NumDims; dim++) {
+                        if (r[dim] > l[dim]) {
+                            ret *= 2;
+                        }
+                    }
+                    return ret;
+                }
+
+                /**
+                 * Gets the bits that the k'th child of the node representing the closed range
+                 * [l, r] at the given level adds to the position of the node. Children are counted
+                 * in the same order as in NodeBasedSegtreeNd, so this is just k when the node is
+                 * split along every dimension that its level splits.
+                 */
+                size_t get_child_digit(Point const & l, Point const & r, size_t level, size_t k) const {
+                    size_t digit = 0, digit_bits = 0;
+                    for (size_t dim = NumDims; dim-- > 0;) {
+                        if (level >= split_levels_[dim]) {
+                            continue;
+                        }
+
+                        if (r[dim] > l[dim]) {
+                            digit |= (k & 1) << digit_bits;
+                            k >>= 1;
+                        }
+                        digit_bits++;
+                    }
+                    return digit;
+                }
+
+                /**
+                 * Gets the index of the child, with the given digit, of the node placed at the
+                 * given index and level.
+                 */
+                size_t get_child_index(size_t index, size_t level, size_t digit) const {
+                    size_t pos = index - level_offsets_[level];
+                    return level_offsets_[level + 1] + ((pos << level_digit_bits_[level]) | digit);
+                }
+
+                /**
+                 * Gets the range of the k'th child of the node representing the closed range
+                 * [l, r], which must exist.
+                 */
+                static void get_child_range(Point const & l, Point const & r, size_t k, Point & child_l, Point & child_r) {
+                    for (size_t dim = NumDims; dim-- > 0;) {
+                        if (r[dim] > l[dim]) {
+                            size_t mid = l[dim] + (r[dim] - l[dim]) / 2;
+                            if ((k & 1) == 0) {
+                                child_r.set(dim, mid);
+                            } else {
+                                child_l.set(dim, mid + 1);
+                            }
+                            k >>= 1;
+                        }
+                    }
+                }
+
+                /**
+                 * Recursively builds the segment tree under the node representing the
+                 * closed range [l, r], which is placed at the given index and level. The top
+                 * fork_levels levels build each of their children on a separate thread.
+                 */
+                template<typename Matrix> WrappedNode * build(Matrix const & matrix, Point const & l, Point const & r, size_t index, size_t level, size_t fork_levels) {
+                    Aggregate val;
+                    size_t num_children = get_num_children(l, r);
+                    if (l == r) {
+                        val = matrix.get(l);
+                    } else if (fork_levels > 0 && get_range_size(l, r) >= PARALLEL_BUILD_GRAIN) {
+                        // the subtrees occupy disjoint slots of the pool, so they can be
+                        // built concurrently.
+                        std::vector<std::pair<Point, Point> > ranges;
+                        std::vector<size_t> indices;
+                        for (size_t k = 0; k < num_children; k++) {
+                            Point child_l(l), child_r(r);
+                            get_child_range(l, r, k, child_l, child_r);
+                            ranges.push_back(std::make_pair(child_l, child_r));
+                            indices.push_back(get_child_index(index, level, get_child_digit(l, r, level, k)));
+                        }
+
+                        std::vector<std::thread> builders;
+                        for (size_t k = 0; k < ranges.size(); k++) {
+                            builders.push_back(std::thread([&, k]() {
+                                build(matrix, ranges[k].first, ranges[k].second, indices[k], level + 1, fork_levels - 1);
+                            }));
+                        }
+
+                        val = this->aggregator_null();
+                        for (size_t k = 0; k < builders.size(); k++) {
+                            builders[k].join();
+                            val = this->aggregate(val, get_node(indices[k])->val);
+                        }
+                    } else {
+                        val = this->aggregator_null();
+                        for (size_t k = 0; k < num_children; k++) {
+                            Point child_l(l), child_r(r);
+                            get_child_range(l, r, k, child_l, child_r);
+                            size_t child_index = get_child_index(index, level, get_child_digit(l, r, level, k));
+                            val = this->aggregate(val, build(matrix, child_l, child_r, child_index, level + 1, 0)->val);
+                        }
+                    }
+                    return new (get_node(index)) WrappedNode(val, l, r, level, num_children);
+                }
+
+                /**
+                 * Recursively destroys the nodes under the given node.
+                 */
+                void destroy(WrappedNode * n) {
+                    for (size_t k = 0; k < NUM_CHILDREN; k++) {
+                        Node * child_node = get_child_node(n, k);
+                        if (child_node == NULL) {
+                            break;
+                        }
+                        destroy(cast(child_node));
+                    }
+                    n->~WrappedNode();
+                }
+
+                /**
+                 * Gets the number of elements in the closed range [l, r].
+                 */
+                static size_t get_range_size(Point const & l, Point const & r) {
+                    return UnrolledDims<0, NumDims>::size(l, r);
+                }
+
+                /**
+                 * Gets the node placed at the index.
+                 */
+                WrappedNode * get_node(size_t index) const {
+                    return (WrappedNode*)pool_ + index;
+                }
+
+                using typename ArrayBasedSegtreeNdBaseTmpl::Node;
+                Node * get_child_node(Node * n, size_t k) {
+                    WrappedNode * wn = cast(n);
+                    if (k >= wn->num_children) {
+                        return NULL;
+                    }
+
+                    size_t level = wn->level;
+                    size_t digit = k;
+                    if (wn->num_children != (size_t(1) << level_digit_bits_[level])) {
+                        digit = get_child_digit(wn->start, wn->end, level, k);
+                    }
+                    return get_node(get_child_index(wn - get_node(0), level, digit));
+                }
+
+                WrappedNode * cast(Node * n) {
+                    return static_cast<WrappedNode*>(n);
+                }
+            private:
+                ArrayBasedSegtreeNd(ArrayBasedSegtreeNd const &);
+                ArrayBasedSegtreeNd & operator = (ArrayBasedSegtreeNd const &);
+        };
+
+    ArrayBasedSegtreeNdTmplParamSpec
+        template<typename Matrix> ArrayBasedSegtreeNdTmpl::ArrayBasedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator, size_t num_threads)
+        : ArrayBasedSegtreeNdBaseTmpl(aggregator) {
+            size_t num_levels = 1;
+            for (size_t k = 0; k < NumDims; k++) {
+                split_levels_[k] = get_split_levels(r[k] - l[k] + 1);
+                if (split_levels_[k] + 1 > num_levels) {
+                    num_levels = split_levels_[k] + 1;
+                }
+            }
+
+            // a level has a slot for every combination of the positions along the dimensions
+            // split so far.
+            tree_size_ = 0;
+            for (size_t level = 0; level < num_levels; level++) {
+                level_offsets_.push_back(tree_size_);
+                size_t width_bits = 0, digit_bits = 0;
+                for (size_t k = 0; k < NumDims; k++) {
+                    width_bits += level < split_levels_[k] ? level : split_levels_[k];
+                    digit_bits += level < split_levels_[k] ? 1 : 0;
+                }
+                tree_size_ += size_t(1) << width_bits;
+                level_digit_bits_.push_back(digit_bits);
+            }
+            level_offsets_.push_back(tree_size_);
+
+            pool_ = (char *)calloc(tree_size_, sizeof(WrappedNode));
+            this->root_ = build(matrix, l, r, 0, 0, get_fork_levels(num_threads, NUM_CHILDREN));
+        }
+
+    ArrayBasedSegtreeNdTmplParamSpec
+        ArrayBasedSegtreeNdTmpl::~ArrayBasedSegtreeNd() {
+            if (!std::is_trivially_destructible<WrappedNode>::value) {
+                destroy(cast(this->root_));
+            }
+
+            free(pool_);
+        }
+}
+
+#endif
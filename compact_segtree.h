@@ -0,0 +1,223 @@
+#ifndef COMPACT_SEGTREE_H_
+#define COMPACT_SEGTREE_H_
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "segtree_lazy.h"
+
+#define CompactSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Lazy>
+#define CompactSegtreeTmpl CompactSegtree<Item, Aggregate, Aggregator, Lazy>
+
+namespace gokul2411s {
+    /**
+     * A segment tree with the same methods as ArrayBasedSegtree, which stores nothing but the
+     * values and lazy objects of its nodes. The range of a node is derived while traversing
+     * from the root, and the values and lazy objects are kept in separate dense arrays
+     * (structure of arrays).
+     *
+     * The tree is split exactly as in ArrayBasedSegtree, at mid = l + (r - l) / 2. Every
+     * non-trivial node splits the range at a different mid, so the n - 1 non-trivial nodes are
+     * addressed by their mid, and the n trivial nodes by their element. This takes exactly
+     * 2n - 1 values, and lazy objects only for the n - 1 nodes that can hold them. The kind of
+     * range update is given by the Lazy objects, as for ArrayBasedSegtree.
+     *
+     * Queries do not change the tree: the lazy objects pending from the ancestors of a node are
+     * passed down and applied on the value read, as for Segtree. The tree cannot be built over
+     * an empty range, for which the constructor throws std::invalid_argument.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Lazy = UpdateLazy<Item> >
+        class CompactSegtree {
+            public:
+                template<typename Iterator> CompactSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const {
+                    return query_impl(l, r, 0, size_ - 1, Lazy());
+                }
+
+                /**
+                 * Applies the given lazy objects on all elements of the closed range [l, r].
+                 */
+                void update(size_t l, size_t r, Lazy const & lazy) {
+                    update(l, r, lazy, 0, size_ - 1);
+                }
+
+                /**
+                 * Overwrites all elements of the closed range [l, r] with the given value.
+                 */
+                void overwrite(size_t l, size_t r, Item const & val) {
+                    Lazy lazy;
+                    lazy.set_overwrite_lazy(val);
+                    update(l, r, lazy, 0, size_ - 1);
+                }
+
+                /**
+                 * Increments all elements of the the closed range [l, r] with the given value.
+                 */
+                void increment(size_t l, size_t r, Item const & val) {
+                    Lazy lazy;
+                    lazy.add_increment_lazy(val);
+                    update(l, r, lazy, 0, size_ - 1);
+                }
+            protected:
+                Aggregator aggregator_;
+                size_t size_;
+
+                // values of the trivial nodes, indexed by element.
+                std::vector<Aggregate> leaf_vals_;
+
+                // values and lazy objects of the non-trivial nodes, indexed by mid.
+                std::vector<Aggregate> vals_;
+                std::vector<Lazy> lazies_;
+
+                /**
+                 * Gets the number of items in the given range, which must not be empty.
+                 */
+                static size_t non_empty_size(size_t num_items) {
+                    if (num_items == 0) {
+                        throw std::invalid_argument("a segment tree cannot be built over an empty range");
+                    }
+                    return num_items;
+                }
+
+                /**
+                 * Gets the point at which the closed range [l, r] is split among the children.
+                 */
+                static size_t get_mid(size_t l, size_t r) {
+                    return l + (r - l) / 2;
+                }
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Gets the value of the node representing the closed range [l, r].
+                 */
+                Aggregate & get_val(size_t l, size_t r) {
+                    return l == r ? leaf_vals_[l] : vals_[get_mid(l, r)];
+                }
+
+                Aggregate const & get_val(size_t l, size_t r) const {
+                    return l == r ? leaf_vals_[l] : vals_[get_mid(l, r)];
+                }
+
+                /**
+                 * Recursively builds the segment tree under the node representing the
+                 * closed range [l, r], and returns the value of that node.
+                 */
+                template<typename Iterator> Aggregate build(Iterator begin, size_t l, size_t r) {
+                    if (l == r) {
+                        leaf_vals_[l] = *(begin + l);
+                        return leaf_vals_[l];
+                    }
+
+                    size_t mid = get_mid(l, r);
+                    Aggregate lval = build(begin, l, mid);
+                    Aggregate rval = build(begin, mid + 1, r);
+                    vals_[mid] = aggregate(lval, rval);
+                    return vals_[mid];
+                }
+
+                /**
+                 * Applies the lazy objects on the node representing the closed range [l, r], and
+                 * keeps them pending for its children.
+                 */
+                void apply_lazy(size_t l, size_t r, Lazy const & lazy) {
+                    Aggregate & val = get_val(l, r);
+                    val = lazy.apply(val, l, r, aggregator_);
+                    if (l < r) {
+                        lazies_[get_mid(l, r)].compose(lazy);
+                    }
+                }
+
+                /**
+                 * Applies any lazy objects from the non-trivial node representing the closed
+                 * range [l, r] to its children.
+                 */
+                void propagate_lazy(size_t l, size_t r) {
+                    size_t mid = get_mid(l, r);
+                    if (lazies_[mid].empty()) {
+                        return;
+                    }
+
+                    Lazy lazy = lazies_[mid];
+                    apply_lazy(l, mid, lazy);
+                    apply_lazy(mid + 1, r, lazy);
+                    lazies_[mid] = Lazy();
+                }
+
+                /**
+                 * Recursively applies the lazy objects on the segment tree under the node
+                 * representing the closed range [nl, nr], for any overlap it may have with the
+                 * closed range [l, r].
+                 */
+                void update(size_t l, size_t r, Lazy const & lazy, size_t nl, size_t nr) {
+                    if (nl > r || nr < l) {
+                        return; // noop
+                    }
+
+                    if (nl >= l && nr <= r) {
+                        apply_lazy(nl, nr, lazy);
+                        return;
+                    }
+
+                    // node is non-trivial
+                    propagate_lazy(nl, nr);
+                    size_t mid = get_mid(nl, nr);
+                    update(l, r, lazy, nl, mid);
+                    update(l, r, lazy, mid + 1, nr);
+                    vals_[mid] = aggregate(get_val(nl, mid), get_val(mid + 1, nr));
+                }
+
+                /**
+                 * Recursively queries the segment tree under the node representing the closed
+                 * range [nl, nr] for its contribution towards the aggregate result of the closed
+                 * range [l, r]. The given lazy objects are pending on the node from its ancestors.
+                 */
+                Aggregate query_impl(size_t l, size_t r, size_t nl, size_t nr, Lazy const & pending) const {
+                    if (nl > r || nr < l) {
+                        return aggregator_null();
+                    }
+
+                    if (nl >= l && nr <= r) {
+                        Aggregate const & val = get_val(nl, nr);
+                        return pending.empty() ? val : pending.apply(val, nl, nr, aggregator_);
+                    }
+
+                    // node is non-trivial. the lazy objects pending from the ancestors were
+                    // applied after those of the node.
+                    size_t mid = get_mid(nl, nr);
+                    Lazy children_pending = lazies_[mid];
+                    children_pending.compose(pending);
+                    return aggregate(query_impl(l, r, nl, mid, children_pending), query_impl(l, r, mid + 1, nr, children_pending));
+                }
+        };
+
+    CompactSegtreeTmplParamSpec
+        template<typename Iterator> CompactSegtreeTmpl::CompactSegtree(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), size_(non_empty_size(end - begin)),
+        leaf_vals_(size_, aggregator.null()),
+        vals_(size_ - 1, aggregator.null()),
+        lazies_(size_ - 1) {
+            build(begin, 0, size_ - 1);
+        }
+}
+
+#endif
@@ -0,0 +1,223 @@
+#ifndef CONCURRENT_SEGTREE_H_
+#define CONCURRENT_SEGTREE_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "array_based_segtree.h"
+
+#define ConcurrentSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Tree>
+#define ConcurrentSegtreeTmpl ConcurrentSegtree<Item, Aggregate, Aggregator, Tree>
+
+namespace gokul2411s {
+    /**
+     * Counts the readers of one version of a ConcurrentSegtree. The count is spread over
+     * several cache lines, and each thread arrives and departs on one of them, so that readers
+     * on different cores do not contend on a single counter.
+     */
+    class ReadIndicator {
+        public:
+            ReadIndicator() {
+                for (size_t k = 0; k < NUM_STRIPES; k++) {
+                    stripes_[k].count.store(0);
+                }
+            }
+
+            void arrive() {
+                stripes_[get_stripe()].count.fetch_add(1);
+            }
+
+            void depart() {
+                stripes_[get_stripe()].count.fetch_sub(1);
+            }
+
+            /**
+             * Gets if no reader is in between arriving and departing.
+             */
+            bool empty() const {
+                for (size_t k = 0; k < NUM_STRIPES; k++) {
+                    if (stripes_[k].count.load() != 0) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        private:
+            static const size_t NUM_STRIPES = 64;
+
+            struct Stripe {
+                std::atomic<long> count;
+                char padding[64 - sizeof(std::atomic<long>)];
+            };
+
+            Stripe stripes_[NUM_STRIPES];
+
+            /**
+             * Gets the stripe of the calling thread.
+             */
+            static size_t get_stripe() {
+                static thread_local size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % NUM_STRIPES;
+                return stripe;
+            }
+    };
+
+    /**
+     * Wraps an updatable segment tree (by default ArrayBasedSegtree) for a mix of concurrent
+     * readers and writers, using the left-right technique. Two instances of the tree are kept.
+     * Readers query whichever instance is published, without taking any lock and without ever
+     * waiting. A writer (writers are serialized among themselves) updates the unpublished
+     * instance, publishes it, waits for the readers still on the old instance to leave, and then
+     * applies the same update to the old instance.
+     *
+     * Every query sees one instance as a whole, so it observes all updates published before it
+     * started and none that were not. The cost is twice the memory and twice the work per update.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Tree = ArrayBasedSegtree<Item, Aggregate, Aggregator> >
+        class ConcurrentSegtree {
+            public:
+                template<typename Iterator> ConcurrentSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+                ~ConcurrentSegtree();
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r);
+
+                /**
+                 * Returns the aggregated results of many closed ranges at once, all from the
+                 * same version of the tree.
+                 */
+                void query_batch(std::vector<std::pair<size_t, size_t> > const & ranges, std::vector<Aggregate> & out);
+
+                /**
+                 * Overwrites all elements of the closed range [l, r] with the given value.
+                 */
+                void overwrite(size_t l, size_t r, Item const & val);
+
+                /**
+                 * Increments all elements of the the closed range [l, r] with the given value.
+                 */
+                void increment(size_t l, size_t r, Item const & val);
+            private:
+                Tree * trees_[2];
+
+                // the instance which readers query.
+                std::atomic<size_t> published_;
+
+                // the read indicator on which new readers arrive.
+                std::atomic<size_t> version_;
+                ReadIndicator read_indicators_[2];
+
+                std::mutex writer_mutex_;
+
+                ConcurrentSegtree(ConcurrentSegtree const &);
+                ConcurrentSegtree & operator = (ConcurrentSegtree const &);
+
+                /**
+                 * Applies the update to both instances, as described for the class.
+                 */
+                template<typename Update> void write(Update const & update) {
+                    std::lock_guard<std::mutex> lock(writer_mutex_);
+
+                    size_t published = published_.load();
+                    update(*trees_[1 - published]);
+                    published_.store(1 - published);
+
+                    // readers which arrived before the switch may still be on the old instance.
+                    // flip the read indicator that new readers use, and wait for both to drain.
+                    size_t version = version_.load();
+                    wait_for_readers(1 - version);
+                    version_.store(1 - version);
+                    wait_for_readers(version);
+
+                    update(*trees_[published]);
+                }
+
+                void wait_for_readers(size_t version) {
+                    while (!read_indicators_[version].empty()) {
+                        std::this_thread::yield();
+                    }
+                }
+
+                /**
+                 * Applies an overwrite on the given instance.
+                 */
+                struct Overwrite {
+                    size_t l;
+                    size_t r;
+                    Item const & val;
+
+                    Overwrite(size_t ll, size_t rr, Item const & vval) :
+                        l(ll), r(rr), val(vval) {}
+
+                    void operator () (Tree & tree) const {
+                        tree.overwrite(l, r, val);
+                    }
+                };
+
+                /**
+                 * Applies an increment on the given instance.
+                 */
+                struct Increment {
+                    size_t l;
+                    size_t r;
+                    Item const & val;
+
+                    Increment(size_t ll, size_t rr, Item const & vval) :
+                        l(ll), r(rr), val(vval) {}
+
+                    void operator () (Tree & tree) const {
+                        tree.increment(l, r, val);
+                    }
+                };
+        };
+
+    ConcurrentSegtreeTmplParamSpec
+        template<typename Iterator> ConcurrentSegtreeTmpl::ConcurrentSegtree(Iterator begin, Iterator end, Aggregator const & aggregator) {
+            trees_[0] = new Tree(begin, end, aggregator);
+            trees_[1] = new Tree(begin, end, aggregator);
+            published_.store(0);
+            version_.store(0);
+        }
+
+    ConcurrentSegtreeTmplParamSpec
+        ConcurrentSegtreeTmpl::~ConcurrentSegtree() {
+            delete trees_[0];
+            delete trees_[1];
+        }
+
+    ConcurrentSegtreeTmplParamSpec
+        Aggregate ConcurrentSegtreeTmpl::query(size_t l, size_t r) {
+            ReadIndicator & read_indicator = read_indicators_[version_.load()];
+            read_indicator.arrive();
+            Aggregate ret = trees_[published_.load()]->query(l, r);
+            read_indicator.depart();
+            return ret;
+        }
+
+    ConcurrentSegtreeTmplParamSpec
+        void ConcurrentSegtreeTmpl::query_batch(std::vector<std::pair<size_t, size_t> > const & ranges, std::vector<Aggregate> & out) {
+            ReadIndicator & read_indicator = read_indicators_[version_.load()];
+            read_indicator.arrive();
+            trees_[published_.load()]->query_batch(ranges, out);
+            read_indicator.depart();
+        }
+
+    ConcurrentSegtreeTmplParamSpec
+        void ConcurrentSegtreeTmpl::overwrite(size_t l, size_t r, Item const & val) {
+            write(Overwrite(l, r, val));
+        }
+
+    ConcurrentSegtreeTmplParamSpec
+        void ConcurrentSegtreeTmpl::increment(size_t l, size_t r, Item const & val) {
+            write(Increment(l, r, val));
+        }
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef DYNAMIC_SEGTREE_H_
+#define DYNAMIC_SEGTREE_H_
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "segtree_lazy.h"
+
+#define DynamicSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Lazy>
+#define DynamicSegtreeTmpl DynamicSegtree<Item, Aggregate, Aggregator, Lazy>
+
+namespace gokul2411s {
+    /**
+     * A segment tree over the keys 0 to 2^64 - 1, all of which start out as the null element.
+     * Nodes are created only when an update first reaches a range (and splits it), so that the
+     * memory taken is proportional to the number of ranges touched by the updates, i.e.
+     * O(log U) nodes per update, rather than to the number of keys. The kind of range update is
+     * given by the Lazy objects, as for ArrayBasedSegtree.
+     *
+     * Nodes are kept in one pool and refer to each other by 32-bit indices, and the ranges of
+     * the nodes are derived while traversing from the root. The two children of a node are
+     * always created together, next to each other in the pool, so that a node needs the index
+     * of its left child only. Index 0 is the root, which is nobody's child, so it marks a node
+     * without children. A node without children has all its elements equal, to the null element
+     * with the node's lazy objects applied on it.
+     *
+     * The 32-bit indices limit the pool to 2^32 nodes (UINT32_MAX + 1). An update which needs
+     * to create children beyond that throws std::length_error, after which the tree is only
+     * partially updated and should be discarded.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Lazy = UpdateLazy<Item> >
+        class DynamicSegtree {
+            public:
+                /**
+                 * Constructs an empty segment tree, with room in the pool for the given number of
+                 * nodes before it needs to grow.
+                 */
+                DynamicSegtree(Aggregator const & aggregator = Aggregator(), size_t reserved_nodes = 0);
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(uint64_t l, uint64_t r) const {
+                    return query_impl(l, r, 0, 0, MAX_KEY, Lazy());
+                }
+
+                /**
+                 * Applies the given lazy objects on all elements of the closed range [l, r].
+                 */
+                void update(uint64_t l, uint64_t r, Lazy const & lazy) {
+                    update(l, r, lazy, 0, 0, MAX_KEY);
+                }
+
+                /**
+                 * Overwrites all elements of the closed range [l, r] with the given value.
+                 */
+                void overwrite(uint64_t l, uint64_t r, Item const & val) {
+                    Lazy lazy;
+                    lazy.set_overwrite_lazy(val);
+                    update(l, r, lazy, 0, 0, MAX_KEY);
+                }
+
+                /**
+                 * Increments all elements of the the closed range [l, r] with the given value.
+                 */
+                void increment(uint64_t l, uint64_t r, Item const & val) {
+                    Lazy lazy;
+                    lazy.add_increment_lazy(val);
+                    update(l, r, lazy, 0, 0, MAX_KEY);
+                }
+
+                /**
+                 * Gets the number of nodes created so far.
+                 */
+                size_t num_nodes() const {
+                    return nodes_.size();
+                }
+            protected:
+                static const uint64_t MAX_KEY = ~uint64_t(0);
+
+                struct WrappedNode {
+                    Aggregate val;
+                    Lazy lazy;
+                    uint32_t children;
+
+                    WrappedNode(Aggregate const & vval) :
+                        val(vval),
+                        lazy(),
+                        children(0) {}
+                };
+
+                Aggregator aggregator_;
+                std::vector<WrappedNode> nodes_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Checks if the node representing the closed range [s, e] can take the lazy
+                 * objects of an update as a whole. The root cannot, since the number of its
+                 * elements does not fit in a size_t; its children take them instead.
+                 */
+                static bool takes_whole(uint64_t s, uint64_t e) {
+                    return s != 0 || e != MAX_KEY;
+                }
+
+                /**
+                 * Applies the lazy objects on the node representing the closed range [s, e], and
+                 * keeps them pending for its children.
+                 */
+                void apply_lazy(uint32_t index, uint64_t s, uint64_t e, Lazy const & lazy) {
+                    WrappedNode & n = nodes_[index];
+                    n.val = lazy.apply(n.val, s, e, aggregator_);
+                    if (s != e) {
+                        n.lazy.compose(lazy);
+                    }
+                }
+
+                /**
+                 * Creates the children of the non-trivial node representing the closed range
+                 * [s, e] if it has none, and applies any lazy objects from the node to them.
+                 */
+                void propagate_lazy(uint32_t index, uint64_t s, uint64_t e) {
+                    if (nodes_[index].children == 0) {
+                        // creating the children may move the pool, so no reference into it is
+                        // held across this.
+                        if (nodes_.size() > UINT32_MAX - 1) {
+                            throw std::length_error("too many nodes for the 32-bit indices of the segment tree");
+                        }
+
+                        uint32_t children = nodes_.size();
+                        nodes_.push_back(WrappedNode(aggregator_null()));
+                        nodes_.push_back(WrappedNode(aggregator_null()));
+                        nodes_[index].children = children;
+                    }
+
+                    if (nodes_[index].lazy.empty()) {
+                        return;
+                    }
+
+                    Lazy lazy = nodes_[index].lazy;
+                    uint32_t children = nodes_[index].children;
+                    uint64_t mid = s + (e - s) / 2;
+                    apply_lazy(children, s, mid, lazy);
+                    apply_lazy(children + 1, mid + 1, e, lazy);
+                    nodes_[index].lazy = Lazy();
+                }
+
+                /**
+                 * Recursively applies the lazy objects on the elements of the closed range [l, r]
+                 * under the node representing the closed range [s, e].
+                 */
+                void update(uint64_t l, uint64_t r, Lazy const & lazy, uint32_t index, uint64_t s, uint64_t e) {
+                    if (s > r || e < l) {
+                        return; // noop
+                    }
+
+                    if (s >= l && e <= r && takes_whole(s, e)) {
+                        apply_lazy(index, s, e, lazy);
+                        return;
+                    }
+
+                    propagate_lazy(index, s, e);
+                    uint32_t children = nodes_[index].children;
+                    uint64_t mid = s + (e - s) / 2;
+                    update(l, r, lazy, children, s, mid);
+                    update(l, r, lazy, children + 1, mid + 1, e);
+                    nodes_[index].val = aggregate(nodes_[children].val, nodes_[children + 1].val);
+                }
+
+                /**
+                 * Recursively queries the segment tree under the node representing the closed
+                 * range [s, e], on which the given lazy objects are pending from its ancestors,
+                 * for its contribution towards the aggregate result of the closed range [l, r].
+                 */
+                Aggregate query_impl(uint64_t l, uint64_t r, uint32_t index, uint64_t s, uint64_t e, Lazy const & pending) const {
+                    if (s > r || e < l) {
+                        return aggregator_null();
+                    }
+
+                    WrappedNode const & n = nodes_[index];
+                    if (s >= l && e <= r) {
+                        return pending.empty() ? n.val : pending.apply(n.val, s, e, aggregator_);
+                    }
+
+                    Lazy children_pending = n.lazy;
+                    children_pending.compose(pending);
+                    if (n.children == 0) {
+                        uint64_t lo = l > s ? l : s, hi = r < e ? r : e;
+                        return children_pending.empty() ? aggregator_null() : children_pending.apply(aggregator_null(), lo, hi, aggregator_);
+                    }
+
+                    uint64_t mid = s + (e - s) / 2;
+                    return aggregate(query_impl(l, r, n.children, s, mid, children_pending), query_impl(l, r, n.children + 1, mid + 1, e, children_pending));
+                }
+        };
+
+    DynamicSegtreeTmplParamSpec
+        const uint64_t DynamicSegtreeTmpl::MAX_KEY;
+
+    DynamicSegtreeTmplParamSpec
+        DynamicSegtreeTmpl::DynamicSegtree(Aggregator const & aggregator, size_t reserved_nodes)
+        : aggregator_(aggregator) {
+            nodes_.reserve(reserved_nodes > 0 ? reserved_nodes : 1);
+            nodes_.push_back(WrappedNode(aggregator_null()));
+        }
+}
+
+#endif
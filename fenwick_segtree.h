@@ -0,0 +1,171 @@
+#ifndef FENWICK_SEGTREE_H_
+#define FENWICK_SEGTREE_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdlib.h>
+
+#define FenwickSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator>
+#define FenwickSegtreeTmpl FenwickSegtree<Item, Aggregate, Aggregator>
+
+namespace gokul2411s {
+    /**
+     * Checks if the aggregator provides an inverse method, which gets the aggregate that
+     * cancels the given one, e.g. -a for sums.
+     */
+    template<typename Aggregator, typename Aggregate>
+        struct AggregatorHasInverse {
+            template<typename A> static char check(decltype(std::declval<A const &>().inverse(std::declval<Aggregate const &>())) *);
+            template<typename A> static long check(...);
+
+            static const bool value = sizeof(check<Aggregator>(NULL)) == 1;
+        };
+
+    /**
+     * A segment tree with the same methods as ArrayBasedSegtree, backed by a pair of Fenwick
+     * trees (binary indexed trees) of n values each instead of nodes. It needs an aggregator
+     * which is commutative and invertible (through an inverse method), and whose
+     * aggregate_times is repeated aggregation, such as sum or xor; the inverse lets a range be
+     * answered as the difference of two prefixes.
+     *
+     * With d_i the difference between the elements i and i - 1 (1-based), the prefix of the
+     * elements up to p is the aggregate over i <= p of d_i times (p - i + 1), i.e. of d_i times
+     * p minus d_i times (i - 1). The first tree holds the d_i, and the second the d_i times
+     * (i - 1), so that a prefix takes two Fenwick sums, and a range increment changes two of
+     * the d_i. Queries and increments take O(log n) time, but an overwrite is applied element by
+     * element, in O((r - l + 1) log n) time.
+     *
+     * The second tree holds values scaled by up to n, and a prefix is the difference of two such
+     * values, so the Aggregate needs headroom for about n times the largest magnitude of an
+     * element (or of a difference of adjacent elements), even when every range aggregate fits.
+     * E.g. sums of values up to 2^40 over 2^20 elements need a 64-bit signed Aggregate. With an
+     * unsigned Aggregate the intermediate values wrap, and the results are still exact modulo
+     * its range.
+     */
+    FenwickSegtreeTmplParamSpec
+        class FenwickSegtree {
+            static_assert(AggregatorHasInverse<Aggregator, Aggregate>::value, "FenwickSegtree needs an aggregator with an inverse method");
+
+            public:
+                template<typename Iterator> FenwickSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const {
+                    return aggregate(get_prefix(r + 1), aggregator_.inverse(get_prefix(l)));
+                }
+
+                /**
+                 * Overwrites all elements of the closed range [l, r] with the given value.
+                 */
+                void overwrite(size_t l, size_t r, Item const & val) {
+                    Aggregate target = aggregate_times(val, 1);
+                    for (size_t i = l; i <= r; i++) {
+                        add(i + 1, i + 1, aggregate(target, aggregator_.inverse(query(i, i))));
+                    }
+                }
+
+                /**
+                 * Increments all elements of the the closed range [l, r] with the given value.
+                 */
+                void increment(size_t l, size_t r, Item const & val) {
+                    add(l + 1, r + 1, aggregate_times(val, 1));
+                }
+            protected:
+                Aggregator aggregator_;
+                size_t size_;
+
+                // the two Fenwick trees, 1-based, so that their entry 0 is unused.
+                std::vector<Aggregate> diffs_;
+                std::vector<Aggregate> scaled_diffs_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Wraps the n-times aggregation method provided by the aggregator.
+                 */
+                template<typename T> Aggregate aggregate_times(T const & a, size_t times) const {
+                    return aggregator_.aggregate_times(a, times);
+                }
+
+                /**
+                 * Aggregates the given value into the entry p (1-based) of the Fenwick tree.
+                 */
+                void add_entry(std::vector<Aggregate> & tree, size_t p, Aggregate const & val) {
+                    for (; p <= size_; p += p & (~p + 1)) {
+                        tree[p] = aggregate(tree[p], val);
+                    }
+                }
+
+                /**
+                 * Gets the aggregate of the entries up to p (1-based) of the Fenwick tree.
+                 */
+                Aggregate get_entries(std::vector<Aggregate> const & tree, size_t p) const {
+                    Aggregate ret = aggregator_null();
+                    for (; p > 0; p &= p - 1) {
+                        ret = aggregate(ret, tree[p]);
+                    }
+                    return ret;
+                }
+
+                /**
+                 * Gets the aggregate of the elements up to p (1-based).
+                 */
+                Aggregate get_prefix(size_t p) const {
+                    return aggregate(aggregate_times(get_entries(diffs_, p), p), aggregator_.inverse(get_entries(scaled_diffs_, p)));
+                }
+
+                /**
+                 * Aggregates the given value into every element of the closed range [l, r]
+                 * (1-based), by changing the differences at l and r + 1.
+                 */
+                void add(size_t l, size_t r, Aggregate const & val) {
+                    add_entry(diffs_, l, val);
+                    add_entry(scaled_diffs_, l, aggregate_times(val, l - 1));
+                    if (r < size_) {
+                        add_entry(diffs_, r + 1, aggregator_.inverse(val));
+                        add_entry(scaled_diffs_, r + 1, aggregator_.inverse(aggregate_times(val, r)));
+                    }
+                }
+        };
+
+    FenwickSegtreeTmplParamSpec
+        template<typename Iterator> FenwickSegtreeTmpl::FenwickSegtree(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), size_(end - begin),
+        diffs_(size_ + 1, aggregator_null()), scaled_diffs_(size_ + 1, aggregator_null()) {
+            Aggregate prev = aggregator_null();
+            for (size_t p = 1; p <= size_; p++, ++begin) {
+                Aggregate cur = *begin;
+                diffs_[p] = aggregate(cur, aggregator_.inverse(prev));
+                scaled_diffs_[p] = aggregate_times(diffs_[p], p - 1);
+                prev = cur;
+            }
+
+            // every entry passes its aggregate on to the next entry covering it, which builds
+            // the trees in O(n) time.
+            for (size_t p = 1; p <= size_; p++) {
+                size_t parent = p + (p & (~p + 1));
+                if (parent <= size_) {
+                    diffs_[parent] = aggregate(diffs_[parent], diffs_[p]);
+                    scaled_diffs_[parent] = aggregate(scaled_diffs_[parent], scaled_diffs_[p]);
+                }
+            }
+        }
+}
+
+#endif
@@ -0,0 +1,294 @@
+#ifndef ITERATIVE_SEGTREE_H_
+#define ITERATIVE_SEGTREE_H_
+
+#include <string>
+
+#include <stdlib.h>
+
+#include "segtree_lazy.h"
+
+#define IterativeSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Lazy>
+#define IterativeSegtreeTmpl IterativeSegtree<Item, Aggregate, Aggregator, Lazy>
+
+namespace gokul2411s {
+    /**
+     * An array based segment tree which answers queries and applies range updates bottom-up,
+     * without any recursion. The leaves are placed at a fixed offset (the number of items rounded
+     * up to a power of two) so that the node covering any element is found by index arithmetic,
+     * and the range of a node is implied by its level.
+     *
+     * Lazy objects are only pushed along the two paths from the root to the boundaries of the
+     * range being updated, which keeps the number of touched nodes at O(log n) and the branches
+     * taken independent of the shape of the range. Queries do not change the tree; every node
+     * they read has its ancestors on those two paths, so the lazy objects pending along the
+     * paths are gathered once and applied on the nodes read. The kind of range update is given
+     * by the Lazy objects, as for ArrayBasedSegtree.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Lazy = UpdateLazy<Item> >
+        class IterativeSegtree {
+            public:
+                template<typename Iterator> IterativeSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+                ~IterativeSegtree();
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const;
+
+                /**
+                 * Applies the given lazy objects on all elements of the closed range [l, r].
+                 */
+                void update(size_t l, size_t r, Lazy const & lazy);
+
+                /**
+                 * Overwrites all elements of the closed range [l, r] with the given value.
+                 */
+                void overwrite(size_t l, size_t r, Item const & val);
+
+                /**
+                 * Increments all elements of the the closed range [l, r] with the given value.
+                 */
+                void increment(size_t l, size_t r, Item const & val);
+            protected:
+                /**
+                 * The most levels that a tree can have below its root.
+                 */
+                static const size_t MAX_HEIGHT = 8 * sizeof(size_t);
+
+                /**
+                 * Encapsulates a value and the lazy objects which are yet to be applied to its
+                 * children. The range of the node is not stored, since it is implied by the index.
+                 */
+                struct IterativeNode {
+                    Aggregate val;
+                    Lazy lazy;
+
+                    IterativeNode(Aggregate const & nval) :
+                        val(nval),
+                        lazy() {}
+                };
+
+                Aggregator aggregator_;
+                size_t leaf_offset_;
+                size_t height_;
+                char * pool_;
+
+                /**
+                 * Gets the number of leaves, which is the smallest power of two not smaller than
+                 * the number of items.
+                 */
+                size_t leaf_count(size_t num_items) const {
+                    size_t psz = 1;
+                    while (psz < num_items) {
+                        psz *= 2;
+                    }
+                    return psz;
+                }
+
+                /**
+                 * Gets the node placed at the index. The root is placed at index 1, and the
+                 * children of the node at index i are placed at 2i and 2i + 1.
+                 */
+                IterativeNode * get_node(size_t index) const {
+                    return (IterativeNode*)pool_ + index;
+                }
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Gets the first element of the node placed at the index, which spans the given
+                 * number of elements.
+                 */
+                size_t get_start(size_t index, size_t len) const {
+                    return index * len - leaf_offset_;
+                }
+
+                /**
+                 * Applies the lazy objects on the node spanning the given number of elements, and
+                 * keeps them pending for its children.
+                 */
+                void apply_lazy(size_t index, size_t len, Lazy const & lazy) {
+                    IterativeNode * n = get_node(index);
+                    size_t start = get_start(index, len);
+                    n->val = lazy.apply(n->val, start, start + len - 1, aggregator_);
+                    if (index < leaf_offset_) {
+                        n->lazy.compose(lazy);
+                    }
+                }
+
+                /**
+                 * Applies any lazy objects on the ancestors of the given leaf to their children,
+                 * starting from the root. After this, no ancestor of the leaf holds a lazy object.
+                 */
+                void push_path(size_t leaf) {
+                    for (size_t h = height_; h > 0; h--) {
+                        size_t index = leaf >> h;
+                        IterativeNode * n = get_node(index);
+                        if (n->lazy.empty()) {
+                            continue;
+                        }
+
+                        size_t child_len = size_t(1) << (h - 1);
+                        apply_lazy(2 * index, child_len, n->lazy);
+                        apply_lazy(2 * index + 1, child_len, n->lazy);
+                        n->lazy = Lazy();
+                    }
+                }
+
+                /**
+                 * Gathers the lazy objects pending from the ancestors of the given leaf, for the
+                 * nodes whose parent is one of those ancestors: pending[h] is for such a node at
+                 * height h. Nothing is pending on the root, at height height_.
+                 */
+                void get_path_pending_lazy(size_t leaf, Lazy * pending) const {
+                    pending[height_] = Lazy();
+                    for (size_t h = height_; h > 0; h--) {
+                        // the lazy object of an ancestor was applied after that of its
+                        // descendants.
+                        pending[h - 1] = get_node(leaf >> h)->lazy;
+                        pending[h - 1].compose(pending[h]);
+                    }
+                }
+
+                /**
+                 * Gets the value of the node placed at the index, at height h, with the lazy
+                 * objects pending from its ancestors applied. Its parent is an ancestor of the
+                 * leaf lo or of the leaf hi, whose pending lazy objects are given.
+                 */
+                Aggregate get_value(size_t index, size_t h, size_t lo, Lazy const * lo_pending, Lazy const * hi_pending) const {
+                    Lazy const & pending = (index >> 1) == (lo >> (h + 1)) ? lo_pending[h] : hi_pending[h];
+                    IterativeNode const * n = get_node(index);
+                    if (pending.empty()) {
+                        return n->val;
+                    }
+
+                    size_t len = size_t(1) << h, start = get_start(index, len);
+                    return pending.apply(n->val, start, start + len - 1, aggregator_);
+                }
+
+                /**
+                 * Recomputes the values of the ancestors of the given leaf from their children.
+                 * An ancestor may have received a lazy object during the update that preceded this
+                 * (the path was pushed clean before it), which is reapplied on top of the children.
+                 */
+                void pull_path(size_t leaf) {
+                    size_t len = 1;
+                    for (size_t index = leaf >> 1; index > 0; index >>= 1) {
+                        len *= 2;
+                        IterativeNode * n = get_node(index);
+                        n->val = aggregate(get_node(2 * index)->val, get_node(2 * index + 1)->val);
+                        if (!n->lazy.empty()) {
+                            size_t start = get_start(index, len);
+                            n->val = n->lazy.apply(n->val, start, start + len - 1, aggregator_);
+                        }
+                    }
+                }
+            private:
+                IterativeSegtree(IterativeSegtree const &);
+                IterativeSegtree & operator = (IterativeSegtree const &);
+        };
+
+    IterativeSegtreeTmplParamSpec
+        const size_t IterativeSegtreeTmpl::MAX_HEIGHT;
+
+    IterativeSegtreeTmplParamSpec
+        template<typename Iterator> IterativeSegtreeTmpl::IterativeSegtree(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), leaf_offset_(leaf_count(end - begin)), height_(0) {
+            while ((size_t(1) << height_) < leaf_offset_) {
+                height_++;
+            }
+
+            size_t num_items = end - begin;
+            pool_ = (char *)calloc(2 * leaf_offset_, sizeof(IterativeNode));
+            for (size_t index = 0; index < leaf_offset_; index++) {
+                Aggregate val = index < num_items ? Aggregate(*(begin + index)) : aggregator_null();
+                new (get_node(leaf_offset_ + index)) IterativeNode(val);
+            }
+
+            for (size_t index = leaf_offset_ - 1; index > 0; index--) {
+                new (get_node(index)) IterativeNode(aggregate(get_node(2 * index)->val, get_node(2 * index + 1)->val));
+            }
+        }
+
+    IterativeSegtreeTmplParamSpec
+        IterativeSegtreeTmpl::~IterativeSegtree() {
+            // index 0 is unused, and was never constructed.
+            for (size_t index = 1; index < 2 * leaf_offset_; index++) {
+                get_node(index)->~IterativeNode();
+            }
+
+            free(pool_);
+        }
+
+    IterativeSegtreeTmplParamSpec
+        Aggregate IterativeSegtreeTmpl::query(size_t l, size_t r) const {
+            size_t lo = l + leaf_offset_, hi = r + leaf_offset_;
+            Lazy lo_pending[MAX_HEIGHT + 1], hi_pending[MAX_HEIGHT + 1];
+            get_path_pending_lazy(lo, lo_pending);
+            get_path_pending_lazy(hi, hi_pending);
+
+            // keep the left and right contributions apart, so that the order of aggregation
+            // is preserved for non-commutative aggregators.
+            Aggregate lres = aggregator_null(), rres = aggregator_null();
+            for (size_t i = lo, j = hi + 1, h = 0; i < j; i >>= 1, j >>= 1, h++) {
+                if (i & 1) {
+                    lres = aggregate(lres, get_value(i++, h, lo, lo_pending, hi_pending));
+                }
+
+                if (j & 1) {
+                    rres = aggregate(get_value(--j, h, lo, lo_pending, hi_pending), rres);
+                }
+            }
+
+            return aggregate(lres, rres);
+        }
+
+    IterativeSegtreeTmplParamSpec
+        void IterativeSegtreeTmpl::update(size_t l, size_t r, Lazy const & lazy) {
+            size_t lo = l + leaf_offset_, hi = r + leaf_offset_;
+            push_path(lo);
+            push_path(hi);
+
+            size_t len = 1;
+            for (size_t i = lo, j = hi + 1; i < j; i >>= 1, j >>= 1, len *= 2) {
+                if (i & 1) {
+                    apply_lazy(i++, len, lazy);
+                }
+
+                if (j & 1) {
+                    apply_lazy(--j, len, lazy);
+                }
+            }
+
+            pull_path(lo);
+            pull_path(hi);
+        }
+
+    IterativeSegtreeTmplParamSpec
+        void IterativeSegtreeTmpl::overwrite(size_t l, size_t r, Item const & val) {
+            Lazy lazy;
+            lazy.set_overwrite_lazy(val);
+            update(l, r, lazy);
+        }
+
+    IterativeSegtreeTmplParamSpec
+        void IterativeSegtreeTmpl::increment(size_t l, size_t r, Item const & val) {
+            Lazy lazy;
+            lazy.add_increment_lazy(val);
+            update(l, r, lazy);
+        }
+}
+
+#endif
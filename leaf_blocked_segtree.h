@@ -0,0 +1,245 @@
+#ifndef LEAF_BLOCKED_SEGTREE_H_
+#define LEAF_BLOCKED_SEGTREE_H_
+
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "updatable_segtree.h"
+
+#define LeafBlockedSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, size_t BlockSize, typename Lazy>
+#define LeafBlockedSegtreeTmpl LeafBlockedSegtree<Item, Aggregate, Aggregator, BlockSize, Lazy>
+
+namespace gokul2411s {
+    /**
+     * A segment tree with the same methods as ArrayBasedSegtree, whose leaves are blocks of
+     * BlockSize contiguous elements (the last block may be shorter). The elements are kept raw
+     * in one array, and only the blocks have nodes, so the tree is about BlockSize times smaller
+     * and a query or update no longer descends through the bottom log(BlockSize) levels of tiny
+     * nodes. Instead, the part of a range that covers a block partially is handled by a plain
+     * loop over the elements of the block, which the compiler can vectorize for simple
+     * aggregators such as sum, min and max.
+     *
+     * The lazy objects of a leaf are pending on the elements of its block. They are applied to
+     * the elements only when an update covers the block partially. The kind of range update is
+     * given by the Lazy objects, as for ArrayBasedSegtree.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, size_t BlockSize = 64, typename Lazy = UpdateLazy<Item> >
+        class LeafBlockedSegtree {
+            public:
+                template<typename Iterator> LeafBlockedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const {
+                    return query_impl(l, r, 0, 0, num_blocks_ - 1, Lazy());
+                }
+
+                /**
+                 * Applies the given lazy objects on all elements of the closed range [l, r].
+                 */
+                void update(size_t l, size_t r, Lazy const & lazy) {
+                    update(l, r, lazy, 0, 0, num_blocks_ - 1);
+                }
+
+                /**
+                 * Overwrites all elements of the closed range [l, r] with the given value.
+                 */
+                void overwrite(size_t l, size_t r, Item const & val) {
+                    Lazy lazy;
+                    lazy.set_overwrite_lazy(val);
+                    update(l, r, lazy, 0, 0, num_blocks_ - 1);
+                }
+
+                /**
+                 * Increments all elements of the the closed range [l, r] with the given value.
+                 */
+                void increment(size_t l, size_t r, Item const & val) {
+                    Lazy lazy;
+                    lazy.add_increment_lazy(val);
+                    update(l, r, lazy, 0, 0, num_blocks_ - 1);
+                }
+            protected:
+                Aggregator aggregator_;
+                size_t size_;
+                size_t num_blocks_;
+
+                std::vector<Aggregate> elements_;
+
+                // values and lazy objects of the nodes over the blocks, in heap order.
+                std::vector<Aggregate> vals_;
+                std::vector<Lazy> lazies_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Gets the first element of the given block.
+                 */
+                static size_t get_block_start(size_t block) {
+                    return block * BlockSize;
+                }
+
+                /**
+                 * Gets the last element of the given block.
+                 */
+                size_t get_block_end(size_t block) const {
+                    size_t end = (block + 1) * BlockSize;
+                    return (end < size_ ? end : size_) - 1;
+                }
+
+                /**
+                 * Aggregates the elements of the closed range [lo, hi], which lies within a block.
+                 */
+                Aggregate reduce_elements(size_t lo, size_t hi) const {
+                    Aggregate const * elements = &elements_[0];
+                    Aggregate ret = aggregator_null();
+                    for (size_t i = lo; i <= hi; i++) {
+                        ret = aggregate(ret, elements[i]);
+                    }
+                    return ret;
+                }
+
+                /**
+                 * Applies the lazy objects on every element of the closed range [lo, hi], which
+                 * lies within a block.
+                 */
+                void apply_to_elements(size_t lo, size_t hi, Lazy const & lazy) {
+                    Aggregate * elements = &elements_[0];
+                    for (size_t i = lo; i <= hi; i++) {
+                        elements[i] = lazy.apply(elements[i], i, i, aggregator_);
+                    }
+                }
+
+                /**
+                 * Recursively builds the segment tree under the node representing the closed
+                 * range of blocks [bl, br], and returns the value of that node.
+                 */
+                Aggregate build(size_t index, size_t bl, size_t br) {
+                    if (bl == br) {
+                        vals_[index] = reduce_elements(get_block_start(bl), get_block_end(br));
+                    } else {
+                        size_t mid = bl + (br - bl) / 2;
+                        vals_[index] = aggregate(build(2 * index + 1, bl, mid), build(2 * index + 2, mid + 1, br));
+                    }
+                    return vals_[index];
+                }
+
+                /**
+                 * Applies the lazy objects on the node representing the closed range of blocks
+                 * [bl, br], and keeps them pending for its children (or the elements of its block).
+                 */
+                void apply_lazy(size_t index, size_t bl, size_t br, Lazy const & lazy) {
+                    vals_[index] = lazy.apply(vals_[index], get_block_start(bl), get_block_end(br), aggregator_);
+                    lazies_[index].compose(lazy);
+                }
+
+                /**
+                 * Applies any lazy objects from the non-trivial node representing the closed
+                 * range of blocks [bl, br] to its children.
+                 */
+                void propagate_lazy(size_t index, size_t bl, size_t br) {
+                    Lazy & lazy = lazies_[index];
+                    if (lazy.empty()) {
+                        return;
+                    }
+
+                    size_t mid = bl + (br - bl) / 2;
+                    apply_lazy(2 * index + 1, bl, mid, lazy);
+                    apply_lazy(2 * index + 2, mid + 1, br, lazy);
+                    lazy = Lazy();
+                }
+
+                /**
+                 * Recursively applies the lazy objects on the elements of the closed range [l, r]
+                 * under the node representing the closed range of blocks [bl, br].
+                 */
+                void update(size_t l, size_t r, Lazy const & lazy, size_t index, size_t bl, size_t br) {
+                    size_t start = get_block_start(bl), end = get_block_end(br);
+                    if (start > r || end < l) {
+                        return; // noop
+                    }
+
+                    if (start >= l && end <= r) {
+                        apply_lazy(index, bl, br, lazy);
+                        return;
+                    }
+
+                    if (bl == br) {
+                        // the block is covered partially, so its elements are brought up to date
+                        // and updated one by one.
+                        Lazy & pending = lazies_[index];
+                        if (!pending.empty()) {
+                            apply_to_elements(start, end, pending);
+                            pending = Lazy();
+                        }
+
+                        apply_to_elements(l > start ? l : start, r < end ? r : end, lazy);
+                        vals_[index] = reduce_elements(start, end);
+                        return;
+                    }
+
+                    propagate_lazy(index, bl, br);
+                    size_t mid = bl + (br - bl) / 2;
+                    update(l, r, lazy, 2 * index + 1, bl, mid);
+                    update(l, r, lazy, 2 * index + 2, mid + 1, br);
+                    vals_[index] = aggregate(vals_[2 * index + 1], vals_[2 * index + 2]);
+                }
+
+                /**
+                 * Recursively queries the segment tree under the node representing the closed
+                 * range of blocks [bl, br], on which the given lazy objects are pending from its
+                 * ancestors, for its contribution towards the aggregate result of the closed
+                 * range [l, r].
+                 */
+                Aggregate query_impl(size_t l, size_t r, size_t index, size_t bl, size_t br, Lazy const & pending) const {
+                    size_t start = get_block_start(bl), end = get_block_end(br);
+                    if (start > r || end < l) {
+                        return aggregator_null();
+                    }
+
+                    if (start >= l && end <= r) {
+                        return pending.apply(vals_[index], start, end, aggregator_);
+                    }
+
+                    Lazy children_pending = lazies_[index];
+                    children_pending.compose(pending);
+                    if (bl == br) {
+                        size_t lo = l > start ? l : start, hi = r < end ? r : end;
+                        return children_pending.apply(reduce_elements(lo, hi), lo, hi, aggregator_);
+                    }
+
+                    size_t mid = bl + (br - bl) / 2;
+                    return aggregate(query_impl(l, r, 2 * index + 1, bl, mid, children_pending), query_impl(l, r, 2 * index + 2, mid + 1, br, children_pending));
+                }
+        };
+
+    LeafBlockedSegtreeTmplParamSpec
+        template<typename Iterator> LeafBlockedSegtreeTmpl::LeafBlockedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), size_(end - begin),
+        num_blocks_((size_ + BlockSize - 1) / BlockSize),
+        elements_(begin, end) {
+            size_t leaves = 1;
+            while (leaves < num_blocks_) {
+                leaves *= 2;
+            }
+            vals_.assign(2 * leaves - 1, aggregator_null());
+            lazies_.assign(2 * leaves - 1, Lazy());
+            build(0, 0, num_blocks_ - 1);
+        }
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef NESTED_SEGTREE_ND_H_
+#define NESTED_SEGTREE_ND_H_
+
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#define NestedSegtreeNdTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
+#define NestedSegtreeNdTmpl NestedSegtreeNd<Item, Aggregate, Aggregator, Point, NumDims>
+
+namespace gokul2411s {
+    /**
+     * An N-dimensional segment tree built as a segment tree over dimension 0, whose nodes are
+     * segment trees over dimension 1, and so on. Unlike NodeBasedSegtreeNd, which splits all
+     * dimensions at once, a query visits O(log n) nodes along each dimension regardless of the
+     * shape of its range, so that any range query takes O(log^d n) time. Thin strips, such as a
+     * full row or column, cost no more than squares. Point updates take O(log^d n) time too, but
+     * range updates are not offered.
+     *
+     * Every dimension k of size n_k uses the bottom-up layout of IterativeSegtree without
+     * rounding up: the elements are placed at n_k to 2n_k - 1, and the children of position i
+     * are 2i and 2i + 1. The entry at a combination of positions, one per dimension, aggregates
+     * the elements that all the positions cover. All entries are held in one flat array of
+     * prod(2n_k) values, in row-major order.
+     */
+    NestedSegtreeNdTmplParamSpec
+        class NestedSegtreeNd {
+            public:
+                template<typename Matrix> NestedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(Point const & l, Point const & r) const {
+                    return query_impl(0, 0, l, r);
+                }
+
+                /**
+                 * Overwrites the element at the given point with the given value.
+                 */
+                void overwrite(Point const & p, Item const & val) {
+                    update(p, val, OVERWRITE);
+                }
+
+                /**
+                 * Increments the element at the given point with the given value.
+                 */
+                void increment(Point const & p, Item const & val) {
+                    update(p, val, INCREMENT);
+                }
+            protected:
+                enum UpdateType {
+                    OVERWRITE,
+                    INCREMENT
+                };
+
+                Aggregator aggregator_;
+                Point start_;
+
+                // the number of elements along each dimension, and the distance in the array
+                // between neighbouring positions along each dimension.
+                size_t sizes_[NumDims];
+                size_t strides_[NumDims];
+
+                std::vector<Aggregate> values_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Wraps the n-times aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate_times(Aggregate const & a, size_t times) const {
+                    return aggregator_.aggregate_times(a, times);
+                }
+
+                /**
+                 * Sets the entry at the given index from its two children along internal_dim,
+                 * the first dimension in which the entry's position (internal_pos) is not an
+                 * element.
+                 */
+                void recompute(size_t index, size_t internal_dim, size_t internal_pos) {
+                    size_t child = index + internal_pos * strides_[internal_dim];
+                    values_[index] = aggregate(values_[child], values_[child + strides_[internal_dim]]);
+                }
+
+                /**
+                 * Recursively builds the entries whose positions along the dimensions before dim
+                 * are given by the index. The entries are built in decreasing order of index, so
+                 * that the children of an entry are always built before it.
+                 */
+                template<typename Matrix> void build(Matrix const & matrix, size_t dim, size_t index, size_t internal_dim, size_t internal_pos, Point & point) {
+                    if (dim == NumDims) {
+                        if (internal_dim == NumDims) {
+                            values_[index] = matrix.get(point);
+                        } else {
+                            recompute(index, internal_dim, internal_pos);
+                        }
+                        return;
+                    }
+
+                    for (size_t pos = 2 * sizes_[dim] - 1; pos > 0; pos--) {
+                        if (pos >= sizes_[dim]) {
+                            point.set(dim, start_[dim] + pos - sizes_[dim]);
+                        }
+
+                        bool internal_here = internal_dim == NumDims && pos < sizes_[dim];
+                        build(matrix, dim + 1, index + pos * strides_[dim], internal_here ? dim : internal_dim, internal_here ? pos : internal_pos, point);
+                    }
+                }
+
+                /**
+                 * Recursively updates the element at the given positions (one per dimension) and
+                 * then recomputes every entry whose positions are ancestors of it, in decreasing
+                 * order of index.
+                 */
+                void update_path(size_t const * leaves, Item const & val, UpdateType update_type, size_t dim, size_t index, size_t internal_dim, size_t internal_pos) {
+                    if (dim == NumDims) {
+                        if (internal_dim != NumDims) {
+                            recompute(index, internal_dim, internal_pos);
+                        } else if (update_type == OVERWRITE) {
+                            values_[index] = aggregate_times(val, 1);
+                        } else {
+                            values_[index] += aggregate_times(val, 1);
+                        }
+                        return;
+                    }
+
+                    for (size_t pos = leaves[dim]; pos > 0; pos >>= 1) {
+                        bool internal_here = internal_dim == NumDims && pos != leaves[dim];
+                        update_path(leaves, val, update_type, dim + 1, index + pos * strides_[dim], internal_here ? dim : internal_dim, internal_here ? pos : internal_pos);
+                    }
+                }
+
+                void update(Point const & p, Item const & val, UpdateType update_type) {
+                    size_t leaves[NumDims];
+                    for (size_t k = 0; k < NumDims; k++) {
+                        leaves[k] = p[k] - start_[k] + sizes_[k];
+                    }
+                    update_path(leaves, val, update_type, 0, 0, NumDims, 0);
+                }
+
+                /**
+                 * Gets the aggregate of the closed range [l, r] restricted to the positions along
+                 * the dimensions before dim that are given by the index.
+                 */
+                Aggregate query_sub(size_t dim, size_t index, Point const & l, Point const & r) const {
+                    return dim == NumDims ? values_[index] : query_impl(dim, index, l, r);
+                }
+
+                /**
+                 * Queries the tree along dimension dim bottom-up, as IterativeSegtree does, and
+                 * descends into the next dimension at every position that it takes.
+                 */
+                Aggregate query_impl(size_t dim, size_t index, Point const & l, Point const & r) const {
+                    size_t lo = l[dim] - start_[dim] + sizes_[dim], hi = r[dim] - start_[dim] + sizes_[dim];
+
+                    // keep the left and right contributions apart, so that the order of aggregation
+                    // is preserved for non-commutative aggregators.
+                    Aggregate lres = aggregator_null(), rres = aggregator_null();
+                    for (size_t i = lo, j = hi + 1; i < j; i >>= 1, j >>= 1) {
+                        if (i & 1) {
+                            lres = aggregate(lres, query_sub(dim + 1, index + (i++) * strides_[dim], l, r));
+                        }
+
+                        if (j & 1) {
+                            rres = aggregate(query_sub(dim + 1, index + (--j) * strides_[dim], l, r), rres);
+                        }
+                    }
+
+                    return aggregate(lres, rres);
+                }
+        };
+
+    NestedSegtreeNdTmplParamSpec
+        template<typename Matrix> NestedSegtreeNdTmpl::NestedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator)
+        : aggregator_(aggregator), start_(l) {
+            size_t total = 1;
+            for (size_t k = NumDims; k-- > 0;) {
+                sizes_[k] = r[k] - l[k] + 1;
+                strides_[k] = total;
+                total *= 2 * sizes_[k];
+            }
+
+            values_.assign(total, aggregator_null());
+            Point point(l);
+            build(matrix, 0, 0, NumDims, 0, point);
+        }
+}
+
+#endif
@@ -1,53 +1,198 @@
 #ifndef NODE_BASED_SEGTREE_ND_H_
 #define NODE_BASED_SEGTREE_ND_H_
 
+#include <new>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <stdlib.h>
 
+#include "segtree_parallel.h"
 #include "updatable_segtree_nd.h"
 
 #define NodeBasedSegtreeNdTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
 #define NodeBasedSegtreeNdTmpl NodeBasedSegtreeNd<Item, Aggregate, Aggregator, Point, NumDims>
-#define UpdatableSegtreeNdTmpl UpdatableSegtreeNd<Item, Aggregate, Aggregator, Point, NumDims>
-#define SegtreeNdTmpl SegtreeNd<Aggregate, Aggregator, Point, NumDims>
+#define NodeBasedSegtreeNdBaseTmpl UpdatableSegtreeNd<NodeBasedSegtreeNdTmpl, Item, Aggregate, Aggregator, Point, NumDims>
 
 namespace gokul2411s {
     NodeBasedSegtreeNdTmplParamSpec
-        class NodeBasedSegtreeNd : public UpdatableSegtreeNdTmpl {
+        class NodeBasedSegtreeNd : public NodeBasedSegtreeNdBaseTmpl {
+            friend class SegtreeNd<NodeBasedSegtreeNdTmpl, Aggregate, Aggregator, Point, NumDims>;
+            friend class NodeBasedSegtreeNdBaseTmpl;
+
             public:
-                template<typename Matrix> NodeBasedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator = Aggregator());
+                /**
+                 * Builds the segment tree over the closed range [l, r] of the matrix. With more than
+                 * one thread, the top levels of the build hand each of their children to a separate
+                 * thread; the tree built is identical to the one built on a single thread.
+                 */
+                template<typename Matrix> NodeBasedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator = Aggregator(), size_t num_threads = 1);
                 ~NodeBasedSegtreeNd();
             protected:
-                using typename UpdatableSegtreeNdTmpl::UpdatableNode;
+                using NodeBasedSegtreeNdBaseTmpl::NUM_CHILDREN;
+
+                using typename NodeBasedSegtreeNdBaseTmpl::UpdatableNode;
                 struct WrappedNode : public UpdatableNode {
-                    std::vector<WrappedNode*> children;
+                    // NULL after the last child.
+                    WrappedNode * children[NUM_CHILDREN];
 
-                    WrappedNode(Aggregate const & val, Point const & start, Point const & end, std::vector<WrappedNode*> const & childrenn) :
-                        UpdatableNode(val, start, end), children(childrenn) {}
+                    WrappedNode(Aggregate const & val, Point const & start, Point const & end, WrappedNode * const * childrenn) :
+                        UpdatableNode(val, start, end) {
+                            for (size_t k = 0; k < NUM_CHILDREN; k++) {
+                                children[k] = childrenn[k];
+                            }
+                    }
                 };
 
+                /**
+                 * Hands out memory for nodes from large chunks, which are freed all at once along
+                 * with the arena. Nodes are never freed one by one, so allocating one is just a
+                 * bump of the count of the current chunk.
+                 */
+                class NodeArena {
+                    public:
+                        NodeArena() {}
+
+                        ~NodeArena() {
+                            for (size_t k = 0; k < chunks_.size(); k++) {
+                                if (!std::is_trivially_destructible<WrappedNode>::value) {
+                                    for (size_t index = 0; index < chunks_[k].used; index++) {
+                                        chunks_[k].nodes[index].~WrappedNode();
+                                    }
+                                }
+                                free(chunks_[k].nodes);
+                            }
+                        }
+
+                        /**
+                         * Gets memory for one node, which the caller constructs in place.
+                         */
+                        void * allocate() {
+                            if (chunks_.empty() || chunks_.back().used == CHUNK_SIZE) {
+                                chunks_.push_back(Chunk(static_cast<WrappedNode *>(malloc(CHUNK_SIZE * sizeof(WrappedNode)))));
+                            }
+                            Chunk & chunk = chunks_.back();
+                            return chunk.nodes + chunk.used++;
+                        }
+
+                        /**
+                         * Takes over all the nodes of the other arena, which is left empty.
+                         */
+                        void splice(NodeArena & other) {
+                            chunks_.insert(chunks_.end(), other.chunks_.begin(), other.chunks_.end());
+                            other.chunks_.clear();
+                        }
+                    private:
+                        static const size_t CHUNK_SIZE = 4096;
+
+                        struct Chunk {
+                            WrappedNode * nodes;
+                            size_t used;
+
+                            Chunk(WrappedNode * nodess) :
+                                nodes(nodess), used(0) {}
+                        };
+
+                        std::vector<Chunk> chunks_;
+
+                        NodeArena(NodeArena const &);
+                        NodeArena & operator = (NodeArena const &);
+                };
+
+                NodeArena arena_;
+
                 /**
                  * Recursively builds the segment tree under the node representing the
-                 * closed range [l, r].
+                 * closed range [l, r], allocating its nodes from the given arena. The top
+                 * fork_levels levels build each of their children on a separate thread.
                  */
-                template<typename Matrix> WrappedNode * build(Matrix const & matrix, Point & l, Point & r) {
+                template<typename Matrix> WrappedNode * build(Matrix const & matrix, Point & l, Point & r, size_t fork_levels, NodeArena & arena) {
                     Aggregate val;
-                    std::vector<WrappedNode*> children;
+                    WrappedNode * children[NUM_CHILDREN];
+                    for (size_t k = 0; k < NUM_CHILDREN; k++) {
+                        children[k] = NULL;
+                    }
+
                     if (l == r) {
                         val = matrix.get(l);
                     } else {
-                        build_children(matrix, l, r, 0, children);
+                        if (fork_levels > 0 && get_range_size(l, r) >= PARALLEL_BUILD_GRAIN) {
+                            build_children_in_parallel(matrix, l, r, fork_levels - 1, children, arena);
+                        } else {
+                            ChildBuilder<Matrix> builder(this, matrix, children, arena);
+                            for_each_child_range(l, r, 0, builder);
+                        }
                         val = this->aggregator_null();
-                        for (typename std::vector<WrappedNode*>::iterator it = children.begin(); it != children.end(); it++) {
-                            val = this->aggregate(val, (*it)->val);
+                        for (size_t k = 0; k < NUM_CHILDREN && children[k] != NULL; k++) {
+                            val = this->aggregate(val, children[k]->val);
                         }
                     }
-                    return new WrappedNode(val, l, r, children);
+                    return new (arena.allocate()) WrappedNode(val, l, r, children);
                 }
 
-                template <typename Matrix> void build_children(Matrix const & matrix, Point & l, Point & r, size_t index_in_dims, std::vector<WrappedNode*> & children_ref) {
+                /**
+                 * Builds the children of a node on the calling thread, in the order in which
+                 * their ranges are visited.
+                 */
+                template<typename Matrix> struct ChildBuilder {
+                    NodeBasedSegtreeNd * tree;
+                    Matrix const & matrix;
+                    WrappedNode ** children;
+                    NodeArena & arena;
+                    size_t num_children;
+
+                    ChildBuilder(NodeBasedSegtreeNd * treee, Matrix const & matrixx, WrappedNode ** childrenn, NodeArena & arenaa) :
+                        tree(treee), matrix(matrixx), children(childrenn), arena(arenaa), num_children(0) {}
+
+                    void operator () (Point & l, Point & r) {
+                        children[num_children++] = tree->build(matrix, l, r, 0, arena);
+                    }
+                };
+
+                /**
+                 * Collects copies of the ranges of the children of a node, in the order in which
+                 * they are visited.
+                 */
+                struct ChildRangeCollector {
+                    std::vector<std::pair<Point, Point> > ranges;
+
+                    void operator () (Point & l, Point & r) {
+                        ranges.push_back(std::make_pair(l, r));
+                    }
+                };
+
+                /**
+                 * Builds each child of the node representing the closed range [l, r] on a
+                 * separate thread, with its own copy of the child's range and its own arena.
+                 * The arenas are handed over to the given one once all threads are done.
+                 */
+                template<typename Matrix> void build_children_in_parallel(Matrix const & matrix, Point & l, Point & r, size_t fork_levels, WrappedNode ** children, NodeArena & arena) {
+                    ChildRangeCollector collector;
+                    for_each_child_range(l, r, 0, collector);
+
+                    std::vector<std::pair<Point, Point> > & ranges = collector.ranges;
+                    std::vector<NodeArena> arenas(ranges.size());
+                    std::vector<std::thread> builders;
+                    for (size_t k = 0; k < ranges.size(); k++) {
+                        builders.push_back(std::thread([&, k]() {
+                            children[k] = build(matrix, ranges[k].first, ranges[k].second, fork_levels, arenas[k]);
+                        }));
+                    }
+
+                    for (size_t k = 0; k < builders.size(); k++) {
+                        builders[k].join();
+                        arena.splice(arenas[k]);
+                    }
+                }
+
+                /**
+                 * Visits the ranges of the children of the node representing the closed range
+                 * [l, r], by halving every dimension from index_in_dims onwards. The given ranges
+                 * are changed during the visit, but restored before returning.
+                 */
+                template <typename Visitor> void for_each_child_range(Point & l, Point & r, size_t index_in_dims, Visitor & visitor) {
                     size_t r_old = r[index_in_dims];
                     size_t l_old = l[index_in_dims];
                     size_t mid = l_old + (r_old - l_old) / 2;
@@ -55,10 +200,9 @@ namespace gokul2411s {
                     // l to mid
                     r.set(index_in_dims, mid);
                     if (index_in_dims == NumDims - 1) {
-                        WrappedNode * child_node = build(matrix, l, r);
-                        children_ref.push_back(child_node);
+                        visitor(l, r);
                     } else {
-                        build_children(matrix, l, r, index_in_dims + 1, children_ref);
+                        for_each_child_range(l, r, index_in_dims + 1, visitor);
                     }
                     r.set(index_in_dims, r_old);
 
@@ -66,39 +210,43 @@ namespace gokul2411s {
                     if (r_old > l_old) {
                         l.set(index_in_dims, mid + 1);
                         if (index_in_dims == NumDims - 1) {
-                            WrappedNode * child_node = build(matrix, l, r);
-                            children_ref.push_back(child_node);
+                            visitor(l, r);
                         } else {
-                            build_children(matrix, l, r, index_in_dims + 1, children_ref);
+                            for_each_child_range(l, r, index_in_dims + 1, visitor);
                         }
                         l.set(index_in_dims, l_old);
                     }
                 }
 
-                using typename SegtreeNdTmpl::Node;
+                /**
+                 * Gets the number of elements in the closed range [l, r].
+                 */
+                static size_t get_range_size(Point const & l, Point const & r) {
+                    return UnrolledDims<0, NumDims>::size(l, r);
+                }
+
+                using typename NodeBasedSegtreeNdBaseTmpl::Node;
                 Node * get_child_node(Node * n, size_t k) {
-                    WrappedNode * wn = cast(n);
-                    if (wn->children.size() <= k) {
-                        return NULL;
-                    } else {
-                        return wn->children[k];
-                    }
+                    return cast(n)->children[k];
                 }
                 
                 WrappedNode * cast(Node * n) {
                     return static_cast<WrappedNode*>(n);
                 }
+            private:
+                NodeBasedSegtreeNd(NodeBasedSegtreeNd const &);
+                NodeBasedSegtreeNd & operator = (NodeBasedSegtreeNd const &);
         };
 
     NodeBasedSegtreeNdTmplParamSpec
-        template<typename Matrix> NodeBasedSegtreeNdTmpl::NodeBasedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator)
-        : UpdatableSegtreeNdTmpl(aggregator) {
-            this->root_ = build(matrix, l, r);
+        template<typename Matrix> NodeBasedSegtreeNdTmpl::NodeBasedSegtreeNd(Matrix const & matrix, Point & l, Point & r, Aggregator const & aggregator, size_t num_threads)
+        : NodeBasedSegtreeNdBaseTmpl(aggregator) {
+            this->root_ = build(matrix, l, r, get_fork_levels(num_threads, NUM_CHILDREN), arena_);
         }
 
     NodeBasedSegtreeNdTmplParamSpec
         NodeBasedSegtreeNdTmpl::~NodeBasedSegtreeNd() {
-            // TODO
+            // the nodes are all freed along with arena_.
         }
 }
 
@@ -0,0 +1,277 @@
+#ifndef PERSISTENT_SEGTREE_H_
+#define PERSISTENT_SEGTREE_H_
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#include "segtree.h"
+#include "updatable_segtree.h"
+
+#define PersistentSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Lazy>
+#define PersistentSegtreeTmpl PersistentSegtree<Item, Aggregate, Aggregator, Lazy>
+#define PersistentSegtreeBaseTmpl Segtree<PersistentSegtreeTmpl, Aggregate, Aggregator, Lazy>
+
+namespace gokul2411s {
+    /**
+     * A segment tree which keeps every version of the elements it has ever held. Each update
+     * creates a new version by copying only the nodes on the paths to the updated range
+     * (O(log n) nodes); all other nodes are shared with the version it was made from. Any
+     * version which has not been released can be queried. Methods given a version which does
+     * not exist, or was released, throw std::invalid_argument. The kind of range update is
+     * given by the Lazy objects, as for ArrayBasedSegtree.
+     *
+     * Nodes are reference counted by the nodes and versions pointing to them, and are
+     * destroyed as soon as no version can reach them.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, typename Lazy = UpdateLazy<Item> >
+        class PersistentSegtree : public PersistentSegtreeBaseTmpl {
+            friend class PersistentSegtreeBaseTmpl;
+
+            public:
+                template<typename Iterator> PersistentSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+                ~PersistentSegtree();
+
+                using PersistentSegtreeBaseTmpl::query;
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r] of the given version.
+                 */
+                Aggregate query(size_t version, size_t l, size_t r) const;
+
+                /**
+                 * Creates a new version from the given one, in which the given lazy objects are
+                 * applied on all elements of the closed range [l, r]. Returns the new version.
+                 */
+                size_t update(size_t version, size_t l, size_t r, Lazy const & lazy);
+
+                /**
+                 * Creates a new version from the given one, in which all elements of the closed range
+                 * [l, r] are overwritten with the given value. Returns the new version.
+                 */
+                size_t overwrite(size_t version, size_t l, size_t r, Item const & val);
+
+                /**
+                 * Creates a new version from the given one, in which all elements of the closed range
+                 * [l, r] are incremented with the given value. Returns the new version.
+                 */
+                size_t increment(size_t version, size_t l, size_t r, Item const & val);
+
+                /**
+                 * Same as above, from the latest version.
+                 */
+                size_t update(size_t l, size_t r, Lazy const & lazy) {
+                    return update(latest_version(), l, r, lazy);
+                }
+
+                size_t overwrite(size_t l, size_t r, Item const & val) {
+                    return overwrite(latest_version(), l, r, val);
+                }
+
+                size_t increment(size_t l, size_t r, Item const & val) {
+                    return increment(latest_version(), l, r, val);
+                }
+
+                /**
+                 * Gets the most recently created version. Versions are numbered from 0, which
+                 * holds the elements that the tree was constructed with.
+                 */
+                size_t latest_version() const {
+                    return versions_.size() - 1;
+                }
+
+                /**
+                 * Releases the given version, which can no longer be queried or updated from.
+                 * The nodes which no other version shares are destroyed. The latest version
+                 * cannot be released, since the methods without a version act on it.
+                 */
+                void release(size_t version);
+            protected:
+                using typename PersistentSegtreeBaseTmpl::Node;
+                struct WrappedNode : public Node, public Lazy {
+                    WrappedNode * left;
+                    WrappedNode * right;
+                    size_t reference_count;
+
+                    WrappedNode(Aggregate const & val, size_t start, size_t end, WrappedNode * leftt, WrappedNode * rightt) :
+                        Node(val, start, end),
+                        Lazy(),
+                        left(leftt),
+                        right(rightt),
+                        reference_count(0) {}
+                };
+
+                // the root of every version, or NULL for the released ones.
+                std::vector<WrappedNode *> versions_;
+
+                /**
+                 * Gets the root of the given version, which must exist and not be released.
+                 */
+                WrappedNode * get_version_root(size_t version) const {
+                    if (version >= versions_.size() || versions_[version] == NULL) {
+                        throw std::invalid_argument("no such version of the segment tree");
+                    }
+                    return versions_[version];
+                }
+
+                /**
+                 * Creates a node with the given children, taking a reference to each of them.
+                 */
+                WrappedNode * create(Aggregate const & val, size_t start, size_t end, WrappedNode * left, WrappedNode * right) {
+                    if (left != NULL) {
+                        left->reference_count++;
+                        right->reference_count++;
+                    }
+                    return new WrappedNode(val, start, end, left, right);
+                }
+
+                /**
+                 * Drops a reference to the node, destroying it (and dropping its references to
+                 * its children) if it was the last one.
+                 */
+                void unref(WrappedNode * n) {
+                    if (--n->reference_count > 0) {
+                        return;
+                    }
+
+                    if (n->left != NULL) {
+                        unref(n->left);
+                        unref(n->right);
+                    }
+                    delete n;
+                }
+
+                /**
+                 * Recursively builds the segment tree under the node representing the
+                 * closed range [l, r].
+                 */
+                template<typename Iterator> WrappedNode * build(Iterator begin, size_t l, size_t r) {
+                    if (l == r) {
+                        return create(*(begin + l), l, r, NULL, NULL);
+                    }
+
+                    size_t mid = l + (r - l) / 2;
+                    WrappedNode * l_node = build(begin, l, mid);
+                    WrappedNode * r_node = build(begin, mid + 1, r);
+                    return create(this->aggregate(l_node->val, r_node->val), l, r, l_node, r_node);
+                }
+
+                /**
+                 * Gets a copy of the node, sharing its children, with the given lazy objects
+                 * applied on it.
+                 */
+                WrappedNode * copy_with_lazy(WrappedNode * n, Lazy const & lazy) {
+                    WrappedNode * copy = create(get_value(n, lazy), n->start, n->end, n->left, n->right);
+                    if (n->non_trivial()) {
+                        static_cast<Lazy &>(*copy) = *n;
+                        copy->compose(lazy);
+                    }
+                    return copy;
+                }
+
+                /**
+                 * Recursively creates the updated version of the segment tree under the node, on
+                 * which the given lazy objects are pending from its ancestors, for any overlap it
+                 * may have with the closed range [l, r]. Nodes that need no change are shared.
+                 */
+                WrappedNode * update(size_t l, size_t r, Lazy const & update_lazy, WrappedNode * n, Lazy const & pending) {
+                    if (n->outside_range(l, r)) {
+                        return pending.empty() ? n : copy_with_lazy(n, pending);
+                    }
+
+                    if (n->within_range(l, r)) {
+                        Lazy lazy = pending;
+                        lazy.compose(update_lazy);
+                        return copy_with_lazy(n, lazy);
+                    }
+
+                    // node is non-trivial
+                    Lazy children_pending = get_children_pending_lazy(n, pending);
+                    WrappedNode * l_node = update(l, r, update_lazy, n->left, children_pending);
+                    WrappedNode * r_node = update(l, r, update_lazy, n->right, children_pending);
+                    return create(this->aggregate(l_node->val, r_node->val), n->start, n->end, l_node, r_node);
+                }
+
+                Node * get_left_child(Node const * n) const {
+                    return static_cast<WrappedNode const *>(n)->left;
+                }
+
+                Node * get_right_child(Node const * n) const {
+                    return static_cast<WrappedNode const *>(n)->right;
+                }
+
+                Aggregate get_value(Node const * n, Lazy const & pending) const {
+                    return pending.apply(n->val, n->start, n->end, this->aggregator_);
+                }
+
+                Lazy get_children_pending_lazy(Node const * n, Lazy const & pending) const {
+                    Lazy children_pending = *static_cast<WrappedNode const *>(n);
+                    children_pending.compose(pending);
+                    return children_pending;
+                }
+            private:
+                PersistentSegtree(PersistentSegtree const &);
+                PersistentSegtree & operator = (PersistentSegtree const &);
+        };
+
+    PersistentSegtreeTmplParamSpec
+        template<typename Iterator> PersistentSegtreeTmpl::PersistentSegtree(Iterator begin, Iterator end, Aggregator const & aggregator) :
+            PersistentSegtreeBaseTmpl(aggregator) {
+                WrappedNode * root = build(begin, 0, end - begin - 1);
+                root->reference_count++;
+                versions_.push_back(root);
+                this->root_ = root;
+        }
+
+    PersistentSegtreeTmplParamSpec
+        PersistentSegtreeTmpl::~PersistentSegtree() {
+            for (size_t version = 0; version < versions_.size(); version++) {
+                if (versions_[version] != NULL) {
+                    unref(versions_[version]);
+                }
+            }
+        }
+
+    PersistentSegtreeTmplParamSpec
+        Aggregate PersistentSegtreeTmpl::query(size_t version, size_t l, size_t r) const {
+            return this->query_impl(l, r, get_version_root(version), Lazy());
+        }
+
+    PersistentSegtreeTmplParamSpec
+        size_t PersistentSegtreeTmpl::update(size_t version, size_t l, size_t r, Lazy const & lazy) {
+            WrappedNode * root = update(l, r, lazy, get_version_root(version), Lazy());
+            root->reference_count++;
+            versions_.push_back(root);
+            this->root_ = root;
+            return latest_version();
+        }
+
+    PersistentSegtreeTmplParamSpec
+        size_t PersistentSegtreeTmpl::overwrite(size_t version, size_t l, size_t r, Item const & val) {
+            Lazy lazy;
+            lazy.set_overwrite_lazy(val);
+            return update(version, l, r, lazy);
+        }
+
+    PersistentSegtreeTmplParamSpec
+        size_t PersistentSegtreeTmpl::increment(size_t version, size_t l, size_t r, Item const & val) {
+            Lazy lazy;
+            lazy.add_increment_lazy(val);
+            return update(version, l, r, lazy);
+        }
+
+    PersistentSegtreeTmplParamSpec
+        void PersistentSegtreeTmpl::release(size_t version) {
+            WrappedNode * root = get_version_root(version);
+            if (version == latest_version()) {
+                throw std::invalid_argument("the latest version of the segment tree cannot be released");
+            }
+
+            versions_[version] = NULL;
+            unref(root);
+        }
+}
+
+#endif
@@ -2,32 +2,121 @@
 #define SEGTREE_H_
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <stdlib.h>
 
+#if defined(__GNUC__)
+#define SEGTREE_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define SEGTREE_PREFETCH(addr)
+#endif
+
 namespace gokul2411s {
-    template<typename Aggregate, typename Aggregator>
+    /**
+     * The lazy objects pending on a segment tree which has none.
+     */
+    struct NoPendingLazy {};
+
+    /**
+     * Base of the 1-dimensional segment trees. The concrete tree is passed in as Derived
+     * (curiously recurring template pattern), so that child access and the recursive
+     * query are dispatched statically and can be inlined by the compiler.
+     *
+     * Derived must provide get_left_child(Node const *) and get_right_child(Node const *),
+     * which are only ever called on non-trivial nodes.
+     *
+     * Queries never modify the tree, so that they can run concurrently with each other. A tree
+     * whose nodes hold lazy objects for their children passes the type of those objects as
+     * PendingLazy, and provides get_value(Node const *, PendingLazy const &), which gets the value
+     * of a node once the lazy objects pending on it from its ancestors are applied, and
+     * get_children_pending_lazy(Node const *, PendingLazy const &), which gets the lazy objects
+     * pending on the children of a node.
+     */
+    template<typename Derived, typename Aggregate, typename Aggregator, typename PendingLazy = NoPendingLazy>
         class Segtree {
             public:
                 /**
-                 * Constructs a segment tree using the given iterable range and aggregator object.
+                 * Returns the aggregated result in the closed range [l, r].
                  */
-                Segtree(Aggregator const & aggregator) :
-                    aggregator_(aggregator) {}
+                Aggregate query(size_t l, size_t r) const {
+                    return query_impl(l, r, root_, PendingLazy());
+                }
 
                 /**
-                 * Destructs the segment tree.
+                 * Returns the aggregated results of many closed ranges at once, in the same order
+                 * as the ranges. The queries are walked through the tree together, a step of each
+                 * in turn, and the nodes that a query steps into next are prefetched while the
+                 * other queries take their step. The memory latency of independent queries is
+                 * thus overlapped instead of being paid one query at a time.
                  */
-                virtual ~Segtree() {}
+                void query_batch(std::vector<std::pair<size_t, size_t> > const & ranges, std::vector<Aggregate> & out) const;
 
                 /**
-                 * Returns the aggregated result in the closed range [l, r].
+                 * Returned by find_first and find_last when no element qualifies.
+                 */
+                static const size_t NOT_FOUND = size_t(-1);
+
+                /**
+                 * Returns the smallest index i within the closed range [l, r] for which pred holds
+                 * on the aggregate of the closed range [l, i], or NOT_FOUND if there is none. pred
+                 * must be monotone, i.e. once it holds on a range, it holds on all longer ones
+                 * starting at l; e.g. the running sum exceeding some k, or the maximum being at
+                 * least some x. The tree is walked down once, in O(log n) time.
+                 */
+                template<typename Predicate> size_t find_first(size_t l, size_t r, Predicate const & pred) const {
+                    if (root_ == NULL) {
+                        return NOT_FOUND;
+                    }
+
+                    Aggregate acc = aggregator_null();
+                    return find_first_impl(l, r, pred, root_, PendingLazy(), acc);
+                }
+
+                /**
+                 * Returns the largest index i within the closed range [l, r] for which pred holds
+                 * on the aggregate of the closed range [i, r], or NOT_FOUND if there is none. pred
+                 * must be monotone, i.e. once it holds on a range, it holds on all longer ones
+                 * ending at r.
+                 */
+                template<typename Predicate> size_t find_last(size_t l, size_t r, Predicate const & pred) const {
+                    if (root_ == NULL) {
+                        return NOT_FOUND;
+                    }
+
+                    Aggregate acc = aggregator_null();
+                    return find_last_impl(l, r, pred, root_, PendingLazy(), acc);
+                }
+
+                /**
+                 * Returns the smallest index i for which pred holds on the aggregate of the
+                 * elements up to i, or the number of elements if there is none, in the manner of
+                 * std::lower_bound. pred must be monotone, as for find_first.
                  */
-                Aggregate query(size_t l, size_t r) {
-                    this->query_impl(l, r, root_);
+                template<typename Predicate> size_t lower_bound_prefix(Predicate const & pred) const {
+                    if (root_ == NULL) {
+                        return 0;
+                    }
+
+                    size_t ret = find_first(root_->start, root_->end, pred);
+                    return ret == NOT_FOUND ? root_->end + 1 : ret;
                 }
 
             protected:
+                /**
+                 * Constructs a segment tree using the given aggregator object.
+                 */
+                Segtree(Aggregator const & aggregator) :
+                    root_(NULL),
+                    aggregator_(aggregator) {}
+
+                /**
+                 * Destructs the segment tree. This is not virtual, since a segment tree
+                 * is never deleted through a pointer to its base.
+                 */
+                ~Segtree() {}
+
                 /**
                  * Encapsulates a value and a closed range for which that value applies.
                  */
@@ -70,23 +159,42 @@ namespace gokul2411s {
                 };
 
                 /**
-                 * Gets the left child of the given node.
+                 * Number of queries walked through the tree together by query_batch.
                  */
-                virtual Node * get_left_child(Node * n) = 0;
+                static const size_t QUERY_BATCH_GROUP_SIZE = 16;
 
                 /**
-                 * Gets the right child of the given node.
+                 * A node that a batched query is yet to visit, along with the lazy objects
+                 * pending on it.
                  */
-                virtual Node * get_right_child(Node * n) = 0;
+                struct BatchFrame {
+                    Node const * node;
+                    PendingLazy pending;
+
+                    BatchFrame(Node const * n, PendingLazy const & p) :
+                        node(n),
+                        pending(p) {}
+                };
 
-                Node * root_;                
+                Node * root_;
                 Aggregator aggregator_;
 
+                /**
+                 * Gets the concrete tree.
+                 */
+                Derived & derived() {
+                    return static_cast<Derived &>(*this);
+                }
+
+                Derived const & derived() const {
+                    return static_cast<Derived const &>(*this);
+                }
+
                 /**
                  * Wraps the null method provided by the aggregator.
                  */
                 Aggregate aggregator_null() const {
-                    return aggregator_.null();   
+                    return aggregator_.null();
                 }
 
                 /**
@@ -108,18 +216,159 @@ namespace gokul2411s {
                  * for its contribution towards the aggregate result of the
                  * closed range [l, r].
                  */
-                virtual Aggregate query_impl(size_t l, size_t r, Node * n) {
+                Aggregate query_impl(size_t l, size_t r, Node const * n, PendingLazy const & pending) const {
                     if (n->outside_range(l, r)) {
                         return aggregator_null();
                     }
 
                     if (n->within_range(l, r)) {
-                        return n->val;
+                        return derived().get_value(n, pending);
                     } else {
-                        return aggregate(query_impl(l, r, get_left_child(n)), query_impl(l, r, get_right_child(n)));
+                        PendingLazy children_pending = derived().get_children_pending_lazy(n, pending);
+                        return aggregate(query_impl(l, r, derived().get_left_child(n), children_pending), query_impl(l, r, derived().get_right_child(n), children_pending));
+                    }
+                }
+
+                /**
+                 * Recursively finds the first index for find_first under the node, where acc
+                 * holds the aggregate of the elements of [l, r] before the node. acc is extended
+                 * over the node when the index does not fall within it.
+                 */
+                template<typename Predicate> size_t find_first_impl(size_t l, size_t r, Predicate const & pred, Node const * n, PendingLazy const & pending, Aggregate & acc) const {
+                    if (n->outside_range(l, r)) {
+                        return NOT_FOUND;
+                    }
+
+                    if (n->within_range(l, r)) {
+                        // the node is descended into only if the index falls within it, so that
+                        // a single path below the boundaries of [l, r] is walked down.
+                        Aggregate candidate = aggregate(acc, derived().get_value(n, pending));
+                        if (!pred(candidate)) {
+                            acc = candidate;
+                            return NOT_FOUND;
+                        }
+
+                        if (!n->non_trivial()) {
+                            return n->start;
+                        }
+                    }
+
+                    PendingLazy children_pending = derived().get_children_pending_lazy(n, pending);
+                    size_t ret = find_first_impl(l, r, pred, derived().get_left_child(n), children_pending, acc);
+                    if (ret != NOT_FOUND) {
+                        return ret;
+                    }
+                    return find_first_impl(l, r, pred, derived().get_right_child(n), children_pending, acc);
+                }
+
+                /**
+                 * Recursively finds the last index for find_last under the node, where acc holds
+                 * the aggregate of the elements of [l, r] after the node.
+                 */
+                template<typename Predicate> size_t find_last_impl(size_t l, size_t r, Predicate const & pred, Node const * n, PendingLazy const & pending, Aggregate & acc) const {
+                    if (n->outside_range(l, r)) {
+                        return NOT_FOUND;
+                    }
+
+                    if (n->within_range(l, r)) {
+                        Aggregate candidate = aggregate(derived().get_value(n, pending), acc);
+                        if (!pred(candidate)) {
+                            acc = candidate;
+                            return NOT_FOUND;
+                        }
+
+                        if (!n->non_trivial()) {
+                            return n->start;
+                        }
+                    }
+
+                    PendingLazy children_pending = derived().get_children_pending_lazy(n, pending);
+                    size_t ret = find_last_impl(l, r, pred, derived().get_right_child(n), children_pending, acc);
+                    if (ret != NOT_FOUND) {
+                        return ret;
+                    }
+                    return find_last_impl(l, r, pred, derived().get_left_child(n), children_pending, acc);
+                }
+
+                /**
+                 * Gets the value of the node, which is just its own value unless Derived
+                 * has lazy objects pending on it.
+                 */
+                Aggregate get_value(Node const * n, PendingLazy const &) const {
+                    return n->val;
+                }
+
+                /**
+                 * Gets the lazy objects pending on the children of the node, which are none
+                 * unless Derived says otherwise.
+                 */
+                PendingLazy get_children_pending_lazy(Node const *, PendingLazy const & pending) const {
+                    return pending;
+                }
+
+                /**
+                 * Takes the next step of a batched query for the closed range [l, r], and
+                 * aggregates into the result any node that it finishes with. Returns false
+                 * once the query has no more nodes to visit.
+                 */
+                bool step_batch_query(size_t l, size_t r, std::vector<BatchFrame> & frames, Aggregate & result) const {
+                    if (frames.empty()) {
+                        return false;
                     }
+
+                    BatchFrame frame = frames.back();
+                    frames.pop_back();
+                    Node const * n = frame.node;
+                    if (n->within_range(l, r)) {
+                        result = aggregate(result, derived().get_value(n, frame.pending));
+                    } else if (!n->outside_range(l, r)) {
+                        Node const * ln = derived().get_left_child(n);
+                        Node const * rn = derived().get_right_child(n);
+                        SEGTREE_PREFETCH(ln);
+                        SEGTREE_PREFETCH(rn);
+
+                        // the right child is pushed first, so that the children are aggregated
+                        // from left to right.
+                        PendingLazy children_pending = derived().get_children_pending_lazy(n, frame.pending);
+                        frames.push_back(BatchFrame(rn, children_pending));
+                        frames.push_back(BatchFrame(ln, children_pending));
+                    }
+                    return true;
                 }
         };
+
+    template<typename Derived, typename Aggregate, typename Aggregator, typename PendingLazy>
+        const size_t Segtree<Derived, Aggregate, Aggregator, PendingLazy>::QUERY_BATCH_GROUP_SIZE;
+
+    template<typename Derived, typename Aggregate, typename Aggregator, typename PendingLazy>
+        const size_t Segtree<Derived, Aggregate, Aggregator, PendingLazy>::NOT_FOUND;
+
+    template<typename Derived, typename Aggregate, typename Aggregator, typename PendingLazy>
+        void Segtree<Derived, Aggregate, Aggregator, PendingLazy>::query_batch(std::vector<std::pair<size_t, size_t> > const & ranges, std::vector<Aggregate> & out) const {
+            out.assign(ranges.size(), aggregator_null());
+
+            std::vector<std::vector<BatchFrame> > frames(QUERY_BATCH_GROUP_SIZE);
+            for (size_t group_start = 0; group_start < ranges.size(); group_start += QUERY_BATCH_GROUP_SIZE) {
+                size_t group_end = group_start + QUERY_BATCH_GROUP_SIZE;
+                if (group_end > ranges.size()) {
+                    group_end = ranges.size();
+                }
+
+                for (size_t q = group_start; q < group_end; q++) {
+                    frames[q - group_start].push_back(BatchFrame(root_, PendingLazy()));
+                }
+
+                bool active = true;
+                while (active) {
+                    active = false;
+                    for (size_t q = group_start; q < group_end; q++) {
+                        if (step_batch_query(ranges[q].first, ranges[q].second, frames[q - group_start], out[q])) {
+                            active = true;
+                        }
+                    }
+                }
+            }
+        }
 }
 
 #endif
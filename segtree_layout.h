@@ -0,0 +1,104 @@
+#ifndef SEGTREE_LAYOUT_H_
+#define SEGTREE_LAYOUT_H_
+
+#include <stdlib.h>
+
+namespace gokul2411s {
+    /**
+     * Places the nodes of a complete binary tree in breadth-first (heap) order. The root is
+     * placed at 0, and the children of the node at i are placed at 2i + 1 and 2i + 2.
+     *
+     * Every layout is constructed with the number of levels in the tree, and offers size(),
+     * root() and child(index, side), where side is 0 for the left child and 1 for the right.
+     */
+    class HeapLayout {
+        public:
+            HeapLayout(size_t levels) :
+                levels_(levels) {}
+
+            /**
+             * Gets the number of slots needed to place all nodes.
+             */
+            size_t size() const {
+                return (size_t(1) << levels_) - 1;
+            }
+
+            size_t root() const {
+                return 0;
+            }
+
+            size_t child(size_t index, size_t side) const {
+                return 2 * index + 1 + side;
+            }
+        private:
+            size_t levels_;
+    };
+
+    /**
+     * Places the nodes of a complete binary tree in blocks, where each block holds a whole
+     * subtree of LevelsPerBlock levels in heap order, and the blocks themselves are placed in
+     * breadth-first order. A root-to-leaf path then touches one block per LevelsPerBlock levels
+     * instead of one slot per level, so choosing the block to fill a cache line (or a page)
+     * cuts the cache (or TLB) misses of a traversal by that factor.
+     *
+     * The block holding the root takes the remainder levels, so that every other block is full
+     * and the tree takes exactly as many slots as in HeapLayout.
+     */
+    template<size_t LevelsPerBlock>
+        class BlockedLayout {
+            public:
+                BlockedLayout(size_t levels) :
+                    levels_(levels),
+                    top_levels_(levels % LevelsPerBlock == 0 ? LevelsPerBlock : levels % LevelsPerBlock),
+                    top_size_((size_t(1) << top_levels_) - 1) {}
+
+                size_t size() const {
+                    return (size_t(1) << levels_) - 1;
+                }
+
+                size_t root() const {
+                    return 0;
+                }
+
+                size_t child(size_t index, size_t side) const {
+                    if (index < top_size_) {
+                        size_t local = 2 * index + 1 + side;
+                        if (local < top_size_) {
+                            return local;
+                        }
+
+                        // the children of the root block are numbered from 1.
+                        return get_block_offset(1 + local - top_size_);
+                    }
+
+                    size_t block = (index - top_size_) / BLOCK_SIZE;
+                    size_t base = top_size_ + block * BLOCK_SIZE;
+                    size_t local = 2 * (index - base) + 1 + side;
+                    if (local < BLOCK_SIZE) {
+                        return base + local;
+                    }
+
+                    // the root block has 2^top_levels_ child blocks, and every other block
+                    // has BLOCK_FANOUT of them.
+                    size_t child_block = 1 + (size_t(1) << top_levels_) + block * BLOCK_FANOUT + (local - BLOCK_SIZE);
+                    return get_block_offset(child_block);
+                }
+            private:
+                static const size_t BLOCK_SIZE = (size_t(1) << LevelsPerBlock) - 1;
+                static const size_t BLOCK_FANOUT = size_t(1) << LevelsPerBlock;
+
+                size_t levels_;
+                size_t top_levels_;
+                size_t top_size_;
+
+                /**
+                 * Gets the slot of the first node in the given block, where block 0 is the
+                 * root block.
+                 */
+                size_t get_block_offset(size_t block) const {
+                    return top_size_ + (block - 1) * BLOCK_SIZE;
+                }
+        };
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SEGTREE_LAZY_H_
+#define SEGTREE_LAZY_H_
+
+#include <stdlib.h>
+
+namespace gokul2411s {
+    /**
+     * Holds two objects, one for overwrite updates and another for increment updates.
+     * An overwrite, if any, is always applied before the increment.
+     *
+     * Every kind of lazy object describes an update of each element of a range, and is used
+     * by the updatable segment trees as follows. A default constructed one is the identity, for
+     * which empty() holds. apply(val, start, end, aggregator) gets the aggregate val of the
+     * closed range [start, end] of the elements, once the update is applied on each of them.
+     * compose(later) combines an update to be applied after this one into this one. The
+     * objects are also compared with ==, to merge neighbouring ranges of a batch of updates.
+     */
+    template<typename Item>
+        struct UpdateLazy {
+            Item overwrite_lazy;
+            Item increment_lazy;
+            bool has_overwrite_lazy;
+            bool has_increment_lazy;
+
+            UpdateLazy() :
+                overwrite_lazy(0),
+                increment_lazy(0),
+                has_overwrite_lazy(false),
+                has_increment_lazy(false) {}
+
+            /**
+             * Sets the overwrite lazy object, invalidating the increment lazy object.
+             */
+            void set_overwrite_lazy(Item const & lazy) {
+                overwrite_lazy = lazy;
+                has_overwrite_lazy = true;
+
+                increment_lazy = 0;
+                has_increment_lazy = false;
+            }
+
+            /**
+             * Adds to the increment lazy object.
+             */
+            void add_increment_lazy(Item const & lazy) {
+                increment_lazy += lazy;
+                has_increment_lazy = true;
+            }
+
+            /**
+             * Resets the lazy objects back to zero.
+             */
+            void reset_lazy() {
+                overwrite_lazy = 0;
+                has_overwrite_lazy = false;
+
+                increment_lazy = 0;
+                has_increment_lazy = false;
+            }
+
+            /**
+             * Gets if there is no lazy object to apply.
+             */
+            bool empty() const {
+                return !has_overwrite_lazy && !has_increment_lazy;
+            }
+
+            /**
+             * Gets the given aggregate of the closed range [start, end] of the elements, once
+             * the lazy objects are applied on each of those elements.
+             */
+            template<typename Aggregate, typename Aggregator> Aggregate apply(Aggregate const & val, size_t start, size_t end, Aggregator const & aggregator) const {
+                size_t times = end - start + 1;
+                Aggregate ret = val;
+                if (has_overwrite_lazy) {
+                    ret = aggregator.aggregate_times(overwrite_lazy, times);
+                }
+
+                if (has_increment_lazy) {
+                    ret += aggregator.aggregate_times(increment_lazy, times);
+                }
+                return ret;
+            }
+
+            /**
+             * Combines the given lazy objects, which are to be applied after these, into
+             * these.
+             */
+            void compose(UpdateLazy const & later) {
+                if (later.has_overwrite_lazy) {
+                    set_overwrite_lazy(later.overwrite_lazy);
+                }
+
+                if (later.has_increment_lazy) {
+                    add_increment_lazy(later.increment_lazy);
+                }
+            }
+
+            bool operator == (UpdateLazy const & other) const {
+                return has_overwrite_lazy == other.has_overwrite_lazy &&
+                    has_increment_lazy == other.has_increment_lazy &&
+                    (!has_overwrite_lazy || overwrite_lazy == other.overwrite_lazy) &&
+                    (!has_increment_lazy || increment_lazy == other.increment_lazy);
+            }
+        };
+
+    /**
+     * Maps every element x to a * x + b. Multiplying by a constant (b = 0), incrementing
+     * (a = 1) and overwriting (a = 0) are special cases. This works for sums, and also for min
+     * and max as long as a is not negative.
+     */
+    template<typename Item>
+        struct AffineLazy {
+            Item a;
+            Item b;
+
+            AffineLazy() :
+                a(1),
+                b(0) {}
+
+            AffineLazy(Item const & aa, Item const & bb) :
+                a(aa),
+                b(bb) {}
+
+            bool empty() const {
+                return a == Item(1) && b == Item(0);
+            }
+
+            template<typename Aggregate, typename Aggregator> Aggregate apply(Aggregate const & val, size_t start, size_t end, Aggregator const & aggregator) const {
+                return val * a + aggregator.aggregate_times(b, end - start + 1);
+            }
+
+            void compose(AffineLazy const & later) {
+                // later.a * (a * x + b) + later.b
+                b = later.a * b + later.b;
+                a = later.a * a;
+            }
+
+            bool operator == (AffineLazy const & other) const {
+                return a == other.a && b == other.b;
+            }
+        };
+
+    /**
+     * Increments every element i with base + step * i, so that consecutive elements receive
+     * an arithmetic progression. This works for sums only.
+     */
+    template<typename Item>
+        struct ProgressionLazy {
+            Item base;
+            Item step;
+
+            ProgressionLazy() :
+                base(0),
+                step(0) {}
+
+            /**
+             * Constructs the update which increments the element l with first, the element
+             * l + 1 with first + step, and so on.
+             */
+            ProgressionLazy(size_t l, Item const & first, Item const & stepp) :
+                base(first - stepp * Item(l)),
+                step(stepp) {}
+
+            bool empty() const {
+                return base == Item(0) && step == Item(0);
+            }
+
+            template<typename Aggregate, typename Aggregator> Aggregate apply(Aggregate const & val, size_t start, size_t end, Aggregator const & aggregator) const {
+                // the indices start to end add up to (start + end) * (end - start + 1) / 2.
+                size_t times = end - start + 1;
+                size_t index_sum = (start + end) % 2 == 0 ? (start + end) / 2 * times : times / 2 * (start + end);
+                return val + aggregator.aggregate_times(base, times) + aggregator.aggregate_times(step, index_sum);
+            }
+
+            void compose(ProgressionLazy const & later) {
+                base += later.base;
+                step += later.step;
+            }
+
+            bool operator == (ProgressionLazy const & other) const {
+                return base == other.base && step == other.step;
+            }
+        };
+}
+
+#endif
@@ -6,29 +6,87 @@
 #include <stdlib.h>
 
 namespace gokul2411s {
-    template<typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
+    /**
+     * Checks on the closed ranges of N-dimensional points, unrolled over the dimensions Dim to
+     * NumDims - 1 at compile time. Every dimension is then indexed with a constant, so that the
+     * compiler can fold the user's Point::operator[] away, and the per-dimension results are
+     * combined with bitwise operators instead of early exits, so that the checks compile to
+     * straight-line code.
+     */
+    template<size_t Dim, size_t NumDims>
+        struct UnrolledDims {
+            /**
+             * Checks if the closed range [start, end] falls completely outside the closed
+             * range [l, r] in some dimension.
+             */
+            template<typename Point> static bool outside(Point const & start, Point const & end, Point const & l, Point const & r) {
+                return ((start[Dim] > r[Dim]) | (end[Dim] < l[Dim])) | UnrolledDims<Dim + 1, NumDims>::outside(start, end, l, r);
+            }
+
+            /**
+             * Checks if the closed range [start, end] falls completely inside the closed
+             * range [l, r] in every dimension.
+             */
+            template<typename Point> static bool within(Point const & start, Point const & end, Point const & l, Point const & r) {
+                return ((start[Dim] >= l[Dim]) & (end[Dim] <= r[Dim])) & UnrolledDims<Dim + 1, NumDims>::within(start, end, l, r);
+            }
+
+            /**
+             * Gets the number of elements in the closed range [start, end].
+             */
+            template<typename Point> static size_t size(Point const & start, Point const & end) {
+                return (end[Dim] - start[Dim] + 1) * UnrolledDims<Dim + 1, NumDims>::size(start, end);
+            }
+        };
+
+    template<size_t NumDims>
+        struct UnrolledDims<NumDims, NumDims> {
+            template<typename Point> static bool outside(Point const &, Point const &, Point const &, Point const &) {
+                return false;
+            }
+
+            template<typename Point> static bool within(Point const &, Point const &, Point const &, Point const &) {
+                return true;
+            }
+
+            template<typename Point> static size_t size(Point const &, Point const &) {
+                return 1;
+            }
+        };
+
+    /**
+     * Base of the N-dimensional segment trees. The concrete tree is passed in as Derived
+     * (curiously recurring template pattern), as for the 1-dimensional Segtree, so that child
+     * access and the recursive query are dispatched statically and can be inlined.
+     *
+     * Derived must provide get_child_node(Node *, size_t k), which gets the k'th child of a
+     * node, or NULL after its last child. It may also provide its own query_impl, which hides
+     * the one given here.
+     */
+    template<typename Derived, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
         class SegtreeNd {
             public:
                 /**
-                 * Constructs a segment tree using the given iterable range and aggregator object.
+                 * Returns the aggregated result in the closed range [l, r].
                  */
-                SegtreeNd(Aggregator const & aggregator) :
-                    aggregator_(aggregator) {}
+                Aggregate query(Point const & l, Point const & r) {
+                    return derived().query_impl(l, r, root_);
+                }
+
+            protected:
+                static const size_t NUM_CHILDREN = size_t(1) << NumDims;
 
                 /**
-                 * Destructs the segment tree.
+                 * Constructs a segment tree using the given iterable range and aggregator object.
                  */
-                virtual ~SegtreeNd() {}
+                SegtreeNd(Aggregator const & aggregator) :
+                    aggregator_(aggregator) {}
 
                 /**
-                 * Returns the aggregated result in the closed range [l, r].
+                 * Destructs the segment tree. This is not virtual, since a segment tree
+                 * is never deleted through a pointer to its base.
                  */
-                Aggregate query(Point const & l, Point const & r) {
-                    query_impl(l, r, root_);
-                }
-
-            protected:
-                static size_t NUM_CHILDREN;
+                ~SegtreeNd() {}
 
                 /**
                  * Encapsulates a value and a closed range for which that value applies.
@@ -59,12 +117,7 @@ namespace gokul2411s {
                      * falls completely outside the closed range [l, r].
                      */
                     bool outside_range(Point const & l, Point const & r) const {
-                        for (size_t k = 0; k < NumDims; k++) {
-                            if (start[k] > r[k] || end[k] < l[k]) {
-                                return true;
-                            }
-                        } 
-                        return false;    
+                        return UnrolledDims<0, NumDims>::outside(start, end, l, r);
                     }
 
                     /**
@@ -72,31 +125,36 @@ namespace gokul2411s {
                      * falls completely inside the closed range [l, r].
                      */
                     bool within_range(Point const & l, Point const & r) const {
-                        for (size_t k = 0; k < NumDims; k++) {
-                            if(start[k] < l[k] || end[k] > r[k]) {
-                                return false;
-                            }
-                        }
-                        return true;
+                        return UnrolledDims<0, NumDims>::within(start, end, l, r);
                     }
 
                     size_t size() const {
-                        size_t ret = 1;
-                        for (size_t k = 0; k < NumDims; k++) {
-                            ret *= (end[k] - start[k] + 1);
-                        }
-                        return ret;
+                        return UnrolledDims<0, NumDims>::size(start, end);
                     }
                 };
 
-                /**
-                 * Gets the k'th child of the given node.
-                 */
-                virtual Node * get_child_node(Node * n, size_t k) = 0;
-
                 Node * root_;                
                 Aggregator aggregator_;
 
+                Derived & derived() {
+                    return static_cast<Derived &>(*this);
+                }
+
+                /**
+                 * Gets the children of the given node into the array, which has room for
+                 * NUM_CHILDREN of them, and returns their number.
+                 */
+                size_t get_children(Node * n, Node ** children) {
+                    size_t num_children = 0;
+                    for (; num_children < NUM_CHILDREN; num_children++) {
+                        children[num_children] = derived().get_child_node(n, num_children);
+                        if (children[num_children] == NULL) {
+                            break;
+                        }
+                    }
+                    return num_children;
+                }
+
                 /**
                  * Wraps the null method provided by the aggregator.
                  */
@@ -122,13 +180,12 @@ namespace gokul2411s {
                  * Sets the value of the node depending on its children.
                  */
                 Aggregate get_children_aggregate(Node * n) {
+                    Node * children[NUM_CHILDREN];
+                    size_t num_children = get_children(n, children);
+
                     Aggregate ret = aggregator_null();
-                    for (size_t k = 0; k < NUM_CHILDREN; k++) {
-                        Node * child_node = get_child_node(n, k);
-                        if (child_node == NULL) {
-                            break;
-                        }
-                        ret = aggregate(ret, child_node->val);
+                    for (size_t k = 0; k < num_children; k++) {
+                        ret = aggregate(ret, children[k]->val);
                     }
                     return ret;
                 }
@@ -137,13 +194,12 @@ namespace gokul2411s {
                  * Sets the value of the node depending on its children, and specified range.
                  */
                 Aggregate get_children_aggregate(Node * n, Point const & l, Point const & r) {
+                    Node * children[NUM_CHILDREN];
+                    size_t num_children = get_children(n, children);
+
                     Aggregate ret = aggregator_null();
-                    for (size_t k = 0; k < NUM_CHILDREN; k++) {
-                        Node * child_node = get_child_node(n, k);
-                        if (child_node == NULL) {
-                            break;
-                        }
-                        ret = aggregate(ret, query_impl(l, r, child_node));
+                    for (size_t k = 0; k < num_children; k++) {
+                        ret = aggregate(ret, derived().query_impl(l, r, children[k]));
                     }
                     return ret;
                 }
@@ -153,7 +209,7 @@ namespace gokul2411s {
                  * for its contribution towards the aggregate result of the
                  * closed range [l, r].
                  */
-                virtual Aggregate query_impl(Point const & l, Point const & r, Node * n) {
+                Aggregate query_impl(Point const & l, Point const & r, Node * n) {
                     if (n->outside_range(l, r)) {
                         return aggregator_null();
                     }
@@ -166,8 +222,8 @@ namespace gokul2411s {
                 }
         };
 
-    template<typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
-        size_t SegtreeNd<Aggregate, Aggregator, Point, NumDims>::NUM_CHILDREN = 1 << NumDims;
+    template<typename Derived, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
+        const size_t SegtreeNd<Derived, Aggregate, Aggregator, Point, NumDims>::NUM_CHILDREN;
 }
 
 #endif
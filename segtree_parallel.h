@@ -0,0 +1,29 @@
+#ifndef SEGTREE_PARALLEL_H_
+#define SEGTREE_PARALLEL_H_
+
+#include <thread>
+
+#include <stdlib.h>
+
+namespace gokul2411s {
+    /**
+     * Ranges with fewer elements than this are always built on the calling thread, since
+     * starting a thread costs more than building them.
+     */
+    static const size_t PARALLEL_BUILD_GRAIN = size_t(1) << 14;
+
+    /**
+     * Gets the number of top levels of a build recursion that hand their children to separate
+     * threads, so that about the given number of threads are kept busy when every node has the
+     * given number of children.
+     */
+    inline size_t get_fork_levels(size_t num_threads, size_t fanout) {
+        size_t levels = 0;
+        for (size_t forked = 1; forked < num_threads; forked *= fanout) {
+            levels++;
+        }
+        return levels;
+    }
+}
+
+#endif
@@ -0,0 +1,267 @@
+#ifndef SLIDING_WINDOW_SEGTREE_H_
+#define SLIDING_WINDOW_SEGTREE_H_
+
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#define SlidingWindowTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator>
+#define SlidingWindowSegtreeTmpl SlidingWindowSegtree<Item, Aggregate, Aggregator>
+#define TwoStackWindowTmpl TwoStackWindow<Item, Aggregate, Aggregator>
+
+namespace gokul2411s {
+    /**
+     * A segment tree over a sliding window of at most a fixed number of elements, which are
+     * pushed at the back and popped from the front. Elements are numbered from the front of
+     * the window, so that element 0 is always the oldest one.
+     *
+     * The elements are kept in a ring buffer, which forms the leaves of a bottom-up tree as in
+     * IterativeSegtree, and a free slot holds the null element. Pushing or popping changes one
+     * leaf and its ancestors in O(log n) time. A range of the window may wrap around the end
+     * of the ring, in which case it is queried as two ranges. All memory is allocated by the
+     * constructor, and none afterwards.
+     */
+    SlidingWindowTmplParamSpec
+        class SlidingWindowSegtree {
+            public:
+                SlidingWindowSegtree(size_t capacity, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Pushes the given value at the back of the window, first popping the front of the
+                 * window if it is full.
+                 */
+                void push_back(Item const & val);
+
+                /**
+                 * Pops the element at the front of the window, which must not be empty.
+                 */
+                void pop_front();
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r] of the window.
+                 */
+                Aggregate query(size_t l, size_t r) const;
+
+                /**
+                 * Returns the aggregated result of the whole window. This takes O(1) time, unless
+                 * the window wraps around the end of the ring, in which case the root would
+                 * aggregate its two parts in the wrong order.
+                 */
+                Aggregate query() const {
+                    if (head_ + size_ <= num_slots_) {
+                        return tree_[1];
+                    }
+                    return query(0, size_ - 1);
+                }
+
+                size_t size() const {
+                    return size_;
+                }
+
+                size_t capacity() const {
+                    return capacity_;
+                }
+            protected:
+                Aggregator aggregator_;
+                size_t capacity_;
+
+                // the number of slots in the ring, which is the capacity rounded up to a power of
+                // two, and the slot of the front of the window.
+                size_t num_slots_;
+                size_t head_;
+                size_t size_;
+
+                // the slots are at num_slots_ to 2 * num_slots_ - 1, and the children of the node
+                // at i are at 2i and 2i + 1.
+                std::vector<Aggregate> tree_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Sets the value of the given slot, and recomputes its ancestors.
+                 */
+                void set_slot(size_t slot, Aggregate const & val) {
+                    size_t i = num_slots_ + slot;
+                    tree_[i] = val;
+                    for (i >>= 1; i > 0; i >>= 1) {
+                        tree_[i] = aggregate(tree_[2 * i], tree_[2 * i + 1]);
+                    }
+                }
+
+                /**
+                 * Returns the aggregated result in the closed range [lo, hi] of the slots.
+                 */
+                Aggregate query_slots(size_t lo, size_t hi) const {
+                    // keep the left and right contributions apart, so that the order of aggregation
+                    // is preserved for non-commutative aggregators.
+                    Aggregate lres = aggregator_null(), rres = aggregator_null();
+                    for (size_t i = lo + num_slots_, j = hi + num_slots_ + 1; i < j; i >>= 1, j >>= 1) {
+                        if (i & 1) {
+                            lres = aggregate(lres, tree_[i++]);
+                        }
+
+                        if (j & 1) {
+                            rres = aggregate(tree_[--j], rres);
+                        }
+                    }
+                    return aggregate(lres, rres);
+                }
+        };
+
+    SlidingWindowTmplParamSpec
+        SlidingWindowSegtreeTmpl::SlidingWindowSegtree(size_t capacity, Aggregator const & aggregator)
+        : aggregator_(aggregator), capacity_(capacity), num_slots_(1), head_(0), size_(0) {
+            while (num_slots_ < capacity_) {
+                num_slots_ *= 2;
+            }
+            tree_.assign(2 * num_slots_, aggregator_null());
+        }
+
+    SlidingWindowTmplParamSpec
+        void SlidingWindowSegtreeTmpl::push_back(Item const & val) {
+            if (size_ == capacity_) {
+                pop_front();
+            }
+
+            set_slot((head_ + size_) & (num_slots_ - 1), val);
+            size_++;
+        }
+
+    SlidingWindowTmplParamSpec
+        void SlidingWindowSegtreeTmpl::pop_front() {
+            set_slot(head_, aggregator_null());
+            head_ = (head_ + 1) & (num_slots_ - 1);
+            size_--;
+        }
+
+    SlidingWindowTmplParamSpec
+        Aggregate SlidingWindowSegtreeTmpl::query(size_t l, size_t r) const {
+            size_t lo = (head_ + l) & (num_slots_ - 1), hi = (head_ + r) & (num_slots_ - 1);
+            if (lo <= hi) {
+                return query_slots(lo, hi);
+            }
+            return aggregate(query_slots(lo, num_slots_ - 1), query_slots(0, hi));
+        }
+
+    /**
+     * A sliding window with the same push_back and pop_front as SlidingWindowSegtree, which
+     * answers only the aggregate of the whole window, in O(1) time. Every operation takes O(1)
+     * amortized time, with a single aggregation most of the time.
+     *
+     * The window is split into a front part, which is popped from, and a back part, which is
+     * pushed to (the two stacks). The back part keeps only the aggregate of its elements. Every
+     * element of the front part keeps the aggregate of itself and everything after it in the
+     * front part. When the front part runs out, the back part becomes the front part, and those
+     * aggregates are computed from its back to its front. Elements are kept in a ring buffer of
+     * the capacity, and all memory is allocated by the constructor.
+     */
+    SlidingWindowTmplParamSpec
+        class TwoStackWindow {
+            public:
+                TwoStackWindow(size_t capacity, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Pushes the given value at the back of the window, first popping the front of the
+                 * window if it is full.
+                 */
+                void push_back(Item const & val);
+
+                /**
+                 * Pops the element at the front of the window, which must not be empty.
+                 */
+                void pop_front();
+
+                /**
+                 * Returns the aggregated result of the whole window.
+                 */
+                Aggregate query() const {
+                    if (front_ == boundary_) {
+                        return back_aggregate_;
+                    }
+                    return aggregate(front_aggregates_[front_ % capacity_], back_aggregate_);
+                }
+
+                size_t size() const {
+                    return back_ - front_;
+                }
+
+                size_t capacity() const {
+                    return capacity_;
+                }
+            protected:
+                Aggregator aggregator_;
+                size_t capacity_;
+
+                // the positions, counted since construction, of the front of the window, of the
+                // first element of the back part, and of the end of the window. the slot of a
+                // position is the position modulo the capacity.
+                size_t front_;
+                size_t boundary_;
+                size_t back_;
+
+                std::vector<Aggregate> elements_;
+                std::vector<Aggregate> front_aggregates_;
+                Aggregate back_aggregate_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+        };
+
+    SlidingWindowTmplParamSpec
+        TwoStackWindowTmpl::TwoStackWindow(size_t capacity, Aggregator const & aggregator)
+        : aggregator_(aggregator), capacity_(capacity), front_(0), boundary_(0), back_(0),
+        elements_(capacity, aggregator.null()), front_aggregates_(capacity, aggregator.null()),
+        back_aggregate_(aggregator.null()) {}
+
+    SlidingWindowTmplParamSpec
+        void TwoStackWindowTmpl::push_back(Item const & val) {
+            if (size() == capacity_) {
+                pop_front();
+            }
+
+            Aggregate & element = elements_[back_ % capacity_];
+            element = val;
+            back_aggregate_ = aggregate(back_aggregate_, element);
+            back_++;
+        }
+
+    SlidingWindowTmplParamSpec
+        void TwoStackWindowTmpl::pop_front() {
+            if (front_ == boundary_) {
+                Aggregate suffix = aggregator_null();
+                for (size_t pos = back_; pos-- > front_;) {
+                    suffix = aggregate(elements_[pos % capacity_], suffix);
+                    front_aggregates_[pos % capacity_] = suffix;
+                }
+                boundary_ = back_;
+                back_aggregate_ = aggregator_null();
+            }
+            front_++;
+        }
+}
+
+#endif
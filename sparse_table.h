@@ -0,0 +1,197 @@
+#ifndef SPARSE_TABLE_H_
+#define SPARSE_TABLE_H_
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SparseTableTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator>
+#define SparseTableTmpl SparseTable<Item, Aggregate, Aggregator>
+#define BlockSparseTableTmpl BlockSparseTable<Item, Aggregate, Aggregator>
+
+namespace gokul2411s {
+    /**
+     * Gets the position of the highest set bit of a non-zero number.
+     */
+    inline size_t highest_bit(uint64_t x) {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(x);
+#else
+        size_t ret = 0;
+        while (x >>= 1) {
+            ret++;
+        }
+        return ret;
+#endif
+    }
+
+    /**
+     * Gets the position of the lowest set bit of a non-zero number.
+     */
+    inline size_t lowest_bit(uint64_t x) {
+#if defined(__GNUC__)
+        return __builtin_ctzll(x);
+#else
+        size_t ret = 0;
+        while ((x & 1) == 0) {
+            x >>= 1;
+            ret++;
+        }
+        return ret;
+#endif
+    }
+
+    /**
+     * A static table answering range queries in O(1) time for idempotent aggregators, i.e. those
+     * for which aggregating an element with itself gives back the element, such as min, max,
+     * gcd, bitwise and / or. It is constructed like ArrayBasedSegtree, but the elements cannot be
+     * updated.
+     *
+     * Level k of the table holds the aggregate of every range of 2^k elements, so that any range
+     * is covered by two (possibly overlapping) ranges of the same level. This takes O(n log n)
+     * time and space to build.
+     */
+    SparseTableTmplParamSpec
+        class SparseTable {
+            public:
+                template<typename Iterator> SparseTable(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const {
+                    size_t level = highest_bit(r - l + 1);
+                    Aggregate const * ranges = &table_[level_offsets_[level]];
+                    return aggregate(ranges[l], ranges[r + 1 - (size_t(1) << level)]);
+                }
+            protected:
+                Aggregator aggregator_;
+
+                // the index of the first range of each level in the table.
+                std::vector<size_t> level_offsets_;
+                std::vector<Aggregate> table_;
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+        };
+
+    SparseTableTmplParamSpec
+        template<typename Iterator> SparseTableTmpl::SparseTable(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), table_(begin, end) {
+            size_t size = table_.size();
+            level_offsets_.push_back(0);
+            for (size_t width = 2; width <= size; width *= 2) {
+                size_t prev = level_offsets_.back(), half = width / 2;
+                level_offsets_.push_back(table_.size());
+                for (size_t i = 0; i + width <= size; i++) {
+                    table_.push_back(aggregate(table_[prev + i], table_[prev + i + half]));
+                }
+            }
+        }
+
+    /**
+     * A static table with the same methods as SparseTable, which takes O(n) time and space to
+     * build. It is meant for selective aggregators, whose aggregate of two elements is always
+     * one of them, such as min and max, and needs the Aggregate to be comparable with ==.
+     *
+     * The elements are split into blocks of 64, and a SparseTable is built over the aggregates
+     * of the blocks only. A range within a block is answered from a bitmask kept for every
+     * element: the bits of element i mark the positions j <= i of its block whose element wins
+     * over every element after it up to i. The lowest marked position at or after the start of
+     * the range then holds the result. A range across blocks combines the ends of its first
+     * and last blocks with the SparseTable over the blocks in between.
+     */
+    SparseTableTmplParamSpec
+        class BlockSparseTable {
+            public:
+                template<typename Iterator> BlockSparseTable(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const {
+                    size_t bl = l / BLOCK_SIZE, br = r / BLOCK_SIZE;
+                    if (bl == br) {
+                        return query_block(l, r);
+                    }
+
+                    Aggregate lres = query_block(l, bl * BLOCK_SIZE + BLOCK_SIZE - 1), rres = query_block(br * BLOCK_SIZE, r);
+                    if (bl + 1 < br) {
+                        lres = aggregate(lres, blocks_.query(bl + 1, br - 1));
+                    }
+                    return aggregate(lres, rres);
+                }
+            protected:
+                static const size_t BLOCK_SIZE = 64;
+
+                Aggregator aggregator_;
+                std::vector<Aggregate> elements_;
+                std::vector<uint64_t> masks_;
+                SparseTable<Aggregate, Aggregate, Aggregator> blocks_;
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r], which lies within
+                 * a block.
+                 */
+                Aggregate query_block(size_t l, size_t r) const {
+                    size_t start = l - l % BLOCK_SIZE;
+                    return elements_[start + lowest_bit(masks_[r] & (~uint64_t(0) << (l - start)))];
+                }
+
+                /**
+                 * Builds the SparseTable over the aggregates of the blocks of the elements.
+                 */
+                static SparseTable<Aggregate, Aggregate, Aggregator> build_blocks(std::vector<Aggregate> const & elements, Aggregator const & aggregator) {
+                    std::vector<Aggregate> block_aggregates;
+                    for (size_t i = 0; i < elements.size(); i++) {
+                        if (i % BLOCK_SIZE == 0) {
+                            block_aggregates.push_back(elements[i]);
+                        } else {
+                            block_aggregates.back() = aggregator.aggregate(block_aggregates.back(), elements[i]);
+                        }
+                    }
+                    return SparseTable<Aggregate, Aggregate, Aggregator>(block_aggregates.begin(), block_aggregates.end(), aggregator);
+                }
+        };
+
+    SparseTableTmplParamSpec
+        template<typename Iterator> BlockSparseTableTmpl::BlockSparseTable(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), elements_(begin, end),
+        masks_(elements_.size()), blocks_(build_blocks(elements_, aggregator)) {
+            // the marked positions form a stack of elements, each of which wins over all
+            // elements after it so far. a new element pops every position that it wins over.
+            uint64_t stack = 0;
+            for (size_t i = 0; i < elements_.size(); i++) {
+                size_t start = i - i % BLOCK_SIZE;
+                if (i == start) {
+                    stack = 0;
+                }
+
+                while (stack != 0) {
+                    Aggregate const & top = elements_[start + highest_bit(stack)];
+                    if (aggregate(top, elements_[i]) == top) {
+                        break;
+                    }
+                    stack &= ~(uint64_t(1) << highest_bit(stack));
+                }
+
+                stack |= uint64_t(1) << (i - start);
+                masks_[i] = stack;
+            }
+        }
+}
+
+#endif
@@ -1,143 +1,197 @@
 #ifndef TREE_BASED_SEGTREE_H_
 #define TREE_BASED_SEGTREE_H_
 
-#include <iostream>
-#include <map>
+#include <new>
 #include <string>
 #include <vector>
 
+#include <stdlib.h>
+
 #include "segtree.h"
 
 #define TreeBasedSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator>
 #define TreeBasedSegtreeTmpl TreeBasedSegtree<Item, Aggregate, Aggregator>
-#define SegtreeTmpl Segtree<Aggregate, Aggregator>
-#define PAIR(a) std::pair<a, a>
-#define MEMO std::map<PAIR(size_t), WrappedNode*>
-#define ITEMCPY std::vector<Item>
+#define TreeBasedSegtreeBaseTmpl Segtree<TreeBasedSegtreeTmpl, Aggregate, Aggregator>
 
 namespace gokul2411s {
+    /**
+     * A segment tree over a stack of elements, which can be pushed and popped at the end.
+     *
+     * The elements are covered by complete blocks, one for every bit set in the number of
+     * elements, from the largest block on the left to the smallest on the right (like a binary
+     * counter). Pushing an element adds a block of one, and merges the last two blocks for as
+     * long as they have the same size; popping an element splits the last block back into the
+     * blocks it was merged from. The nodes are allocated on a stack-like arena, and the nodes
+     * made by a push are exactly the ones that the matching pop frees, so neither ever looks up
+     * or moves a node. A spine of at most one node per block joins the blocks under the root.
+     *
+     * Push and pop take O(log n) time in the worst case and O(1) amortized over pushes, and
+     * the constructor takes O(n) time.
+     */
     TreeBasedSegtreeTmplParamSpec
-        class TreeBasedSegtree : public SegtreeTmpl {
+        class TreeBasedSegtree : public TreeBasedSegtreeBaseTmpl {
+            friend class TreeBasedSegtreeBaseTmpl;
+
             public:
                 template<typename Iterator> TreeBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator);
                 ~TreeBasedSegtree();
+
+                /**
+                 * Pushes the given element at the end.
+                 */
                 void push(Item const & val);
+
+                /**
+                 * Pops the element at the end. The tree must not be empty.
+                 */
                 void pop();
             protected:
-                using typename SegtreeTmpl::Node;
+                using typename TreeBasedSegtreeBaseTmpl::Node;
                 struct WrappedNode : public Node {
                     WrappedNode * left;
                     WrappedNode * right;
-                    size_t reference_count;
 
                     WrappedNode(Aggregate const & val, size_t start, size_t end, WrappedNode * leftt, WrappedNode * rightt) :
                         Node(val, start, end),
                         left(leftt),
-                        right(rightt),
-                        reference_count(0) {}
+                        right(rightt) {}
                 };
 
                 WrappedNode * cast(Node * n) {
                     return static_cast<WrappedNode*>(n);
                 }
 
-                WrappedNode * build(size_t l, size_t r) {
-                    PAIR(size_t) p(std::make_pair(l, r));
-                    typename MEMO::iterator memo_it = memo_.find(p);
-                    if (memo_it != memo_.end()) {
-                        return memo_it->second;
+                /**
+                 * Allocates a node on top of the arena.
+                 */
+                WrappedNode * allocate(Aggregate const & val, size_t start, size_t end, WrappedNode * left, WrappedNode * right) {
+                    size_t chunk = num_nodes_ / ARENA_CHUNK_SIZE;
+                    if (chunk == chunks_.size()) {
+                        chunks_.push_back(static_cast<WrappedNode *>(malloc(ARENA_CHUNK_SIZE * sizeof(WrappedNode))));
                     }
 
-                    Aggregate val;
-                    WrappedNode * l_node = NULL, * r_node = NULL;
-                    if (l == r) {
-                        val = itemcpy_[l];
-                    } else {
-                        size_t mid = l + (r - l) / 2;
-                        l_node = build(l, mid);
-                        l_node->reference_count++;
-                        
-                        r_node = build(mid + 1, r);
-                        r_node->reference_count++;
-                        
-                        val = this->aggregate(l_node->val, r_node->val);
-                    }
-                    WrappedNode * n = new WrappedNode(val, l, r, l_node, r_node);
-                    memo_.insert(std::make_pair(p, n));
+                    WrappedNode * n = new (chunks_[chunk] + num_nodes_ % ARENA_CHUNK_SIZE) WrappedNode(val, start, end, left, right);
+                    num_nodes_++;
                     return n;
                 }
-                
-                void destroy(size_t l, size_t r) {
-                    PAIR(size_t) p(std::make_pair(l, r));
-                    typename MEMO::iterator memo_it = memo_.find(p);
-                    if (memo_it == memo_.end()) {
-                        return; // already destroyed
+
+                /**
+                 * Frees the node on top of the arena.
+                 */
+                void deallocate() {
+                    num_nodes_--;
+                    (chunks_[num_nodes_ / ARENA_CHUNK_SIZE] + num_nodes_ % ARENA_CHUNK_SIZE)->~WrappedNode();
+
+                    // one empty chunk is kept, so that pushing and popping around the end of a
+                    // chunk does not allocate every time.
+                    while (chunks_.size() > num_nodes_ / ARENA_CHUNK_SIZE + 2) {
+                        free(chunks_.back());
+                        chunks_.pop_back();
+                    }
+                }
+
+                /**
+                 * Rebuilds the spine above the blocks from the given block onwards, and updates
+                 * the root. The spine node at index k joins the blocks 0 to k with the block k + 1.
+                 */
+                void rebuild_spine(size_t changed_block) {
+                    spine_.erase(spine_.begin() + (changed_block > 0 ? changed_block - 1 : 0), spine_.end());
+                    while (spine_.size() + 1 < blocks_.size()) {
+                        WrappedNode * l_node = spine_.empty() ? blocks_[0] : &spine_.back();
+                        WrappedNode * r_node = blocks_[spine_.size() + 1];
+                        spine_.push_back(WrappedNode(this->aggregate(l_node->val, r_node->val), 0, r_node->end, l_node, r_node));
                     }
 
-                    WrappedNode * n = memo_it->second;
-                    if (l < r) {
-                        size_t mid = l + (r - l) / 2;
-                        WrappedNode * l_node = n->left;
-                        l_node->reference_count--;
-                        if (l_node->reference_count == 0) {
-                            destroy(l, mid);
-                        }
-                        
-                        WrappedNode * r_node = n->right;
-                        r_node->reference_count--;
-                        if (r_node->reference_count == 0) {
-                            destroy(mid + 1, r);
-                        }
+                    if (blocks_.empty()) {
+                        this->root_ = NULL;
+                    } else {
+                        this->root_ = spine_.empty() ? blocks_[0] : &spine_.back();
                     }
-                    delete n;
-                    memo_.erase(p);
                 }
 
-                Node * get_left_child(Node * n) {
-                    return cast(n)->left;
+                Node * get_left_child(Node const * n) const {
+                    return static_cast<WrappedNode const *>(n)->left;
                 }
 
-                Node * get_right_child(Node * n) {
-                    return cast(n)->right;
+                Node * get_right_child(Node const * n) const {
+                    return static_cast<WrappedNode const *>(n)->right;
                 }
 
             private:
-                ITEMCPY itemcpy_;
-                MEMO memo_;
+                static const size_t ARENA_CHUNK_SIZE = 1024;
+
+                // the arena, as chunks that are never moved.
+                std::vector<WrappedNode *> chunks_;
+                size_t num_nodes_;
+
+                // roots of the blocks, from the largest to the smallest.
+                std::vector<WrappedNode *> blocks_;
+
+                // has room reserved for a node per bit of the size, so it is never moved.
+                std::vector<WrappedNode> spine_;
+
                 size_t size_;
+
+                TreeBasedSegtree(TreeBasedSegtree const &);
+                TreeBasedSegtree & operator = (TreeBasedSegtree const &);
         };
 
     TreeBasedSegtreeTmplParamSpec
         template<typename Iterator> TreeBasedSegtreeTmpl::TreeBasedSegtree(Iterator begin, Iterator end, Aggregator const & aggregator) :
-            SegtreeTmpl(aggregator), size_(end - begin), itemcpy_(begin, end) {
-                for (size_t index = 0; index < size_; index++) {
-                    build(0, index);
+            TreeBasedSegtreeBaseTmpl(aggregator), num_nodes_(0), size_(0) {
+                spine_.reserve(sizeof(size_t) * 8);
+                this->root_ = NULL;
+                for (Iterator it = begin; it != end; ++it) {
+                    push(*it);
                 }
-                this->root_ = memo_.find(std::make_pair(0, size_ - 1))->second; 
         }
-    
+
     TreeBasedSegtreeTmplParamSpec
         void TreeBasedSegtreeTmpl::push(Item const & val) {
+            blocks_.push_back(allocate(val, size_, size_, NULL, NULL));
             size_++;
-            build(0, size_ - 1);
-            this->root_ = memo_.find(std::make_pair(0, size_ - 1))->second; 
-            
-            itemcpy_.push_back(val);
+
+            // merge the last two blocks while they are of the same size.
+            while (blocks_.size() >= 2) {
+                WrappedNode * r_node = blocks_[blocks_.size() - 1];
+                WrappedNode * l_node = blocks_[blocks_.size() - 2];
+                if (l_node->end - l_node->start != r_node->end - r_node->start) {
+                    break;
+                }
+
+                blocks_.pop_back();
+                blocks_.back() = allocate(this->aggregate(l_node->val, r_node->val), l_node->start, r_node->end, l_node, r_node);
+            }
+
+            rebuild_spine(blocks_.size() - 1);
         }
-    
+
     TreeBasedSegtreeTmplParamSpec
         void TreeBasedSegtreeTmpl::pop() {
-            itemcpy_.pop_back();
-            
-            this->root_ = memo_.find(std::make_pair(0, size_ - 2))->second; 
-            destroy(0, size_ - 1);
+            // the last block splits into the left children along its right edge, and the nodes
+            // on that edge are the ones that the last push allocated.
+            WrappedNode * n = blocks_.back();
+            blocks_.pop_back();
+            size_t changed_block = blocks_.size();
+            while (n->non_trivial()) {
+                blocks_.push_back(n->left);
+                n = n->right;
+                deallocate();
+            }
+            deallocate();
             size_--;
+
+            rebuild_spine(changed_block);
         }
 
     TreeBasedSegtreeTmplParamSpec
         TreeBasedSegtreeTmpl::~TreeBasedSegtree() {
-            for (size_t index = 0; index < size_; index++) {
-               destroy(0, index); 
+            while (num_nodes_ > 0) {
+                deallocate();
+            }
+
+            for (size_t chunk = 0; chunk < chunks_.size(); chunk++) {
+                free(chunks_[chunk]);
             }
         }
 }
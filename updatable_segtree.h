@@ -1,22 +1,68 @@
 #ifndef UPDATABLE_SEGTREE_H_
 #define UPDATABLE_SEGTREE_H_
 
+#include <algorithm>
+#include <vector>
+
 #include <stdlib.h>
 
 #include "segtree.h"
+#include "segtree_lazy.h"
 
-#define UpdatableSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator>
-#define UpdatableSegtreeTmpl UpdatableSegtree<Item, Aggregate, Aggregator>
-#define SegtreeTmpl Segtree<Aggregate, Aggregator>
+#define UpdatableSegtreeTmplParamSpec template<typename Derived, typename Item, typename Aggregate, typename Aggregator, typename Lazy>
+#define UpdatableSegtreeTmpl UpdatableSegtree<Derived, Item, Aggregate, Aggregator, Lazy>
+#define SegtreeTmpl Segtree<Derived, Aggregate, Aggregator, Lazy>
 
 namespace gokul2411s {
+    /**
+     * Base of the 1-dimensional segment trees which support range updates. As with Segtree,
+     * the concrete tree is passed in as Derived and all child access is static.
+     *
+     * The kind of update is given by the Lazy objects (see segtree_lazy.h) that the nodes
+     * keep. With UpdateLazy, the elements are overwritten or incremented; other kinds, such as
+     * AffineLazy, are applied on a range with update().
+     */
     UpdatableSegtreeTmplParamSpec
         class UpdatableSegtree : public SegtreeTmpl {
             public:
-                UpdatableSegtree(Aggregator const & aggregator) :
-                    SegtreeTmpl(aggregator) {}
+                enum UpdateType {
+                    OVERWRITE,
+                    INCREMENT
+                };
 
-                virtual ~UpdatableSegtree() {}
+                /**
+                 * An update of all elements of the closed range [l, r] with the given lazy
+                 * objects.
+                 */
+                struct RangeUpdate {
+                    size_t l;
+                    size_t r;
+                    Lazy lazy;
+
+                    RangeUpdate(size_t ll, size_t rr, Lazy const & llazy) :
+                        l(ll),
+                        r(rr),
+                        lazy(llazy) {}
+
+                    /**
+                     * Constructs an overwrite or increment, as specified by the update type,
+                     * with the given value. This needs the lazy objects to be UpdateLazy.
+                     */
+                    RangeUpdate(size_t ll, size_t rr, Item const & val, UpdateType update_type) :
+                        l(ll),
+                        r(rr) {
+                        if (update_type == OVERWRITE) {
+                            lazy.set_overwrite_lazy(val);
+                        } else {
+                            lazy.add_increment_lazy(val);
+                        }
+                    }
+                };
+
+                /**
+                 * Applies the given lazy objects on all elements of the closed range [l, r].
+                 */
+                void update(size_t l, size_t r, Lazy const & lazy);
 
                 /**
                  * Overwrites all elements of the closed range [l, r] with the given value.
@@ -27,59 +73,44 @@ namespace gokul2411s {
                  * Increments all elements of the the closed range [l, r] with the given value.
                  */
                 void increment(size_t l, size_t r, Item const & val);
+
+                /**
+                 * Applies the given updates, with the same result as applying them one at a time
+                 * in the given order. The updates are first coalesced into disjoint ranges, each
+                 * carrying the combined effect of all updates on it (e.g. a later overwrite drops
+                 * everything before it, and increments add up), and then applied in a single
+                 * traversal of the tree.
+                 */
+                void apply_batch(std::vector<RangeUpdate> const & updates);
             protected:
-                enum UpdateType {
-                    OVERWRITE,
-                    INCREMENT
-                };
+                UpdatableSegtree(Aggregator const & aggregator) :
+                    SegtreeTmpl(aggregator) {}
+
+                ~UpdatableSegtree() {}
 
                 using typename SegtreeTmpl::Node;
                 /**
-                 * Wraps the Node object with two objects, one for overwrite updates and another for
-                 * increment updates that are used to propagate updates to children nodes lazily.
+                 * Wraps the Node object with the lazy objects that are used to propagate updates
+                 * to children nodes lazily.
                  */
-                struct UpdatableNode : public Node {
-                    Item overwrite_lazy; 
-                    Item increment_lazy;
-                    bool has_overwrite_lazy;
-                    bool has_increment_lazy;
-
+                struct UpdatableNode : public Node, public Lazy {
                     UpdatableNode(Aggregate const & val, size_t start, size_t end) :
                         Node(val, start, end),
-                        overwrite_lazy(0),
-                        increment_lazy(0),
-                        has_overwrite_lazy(false),
-                        has_increment_lazy(false) {}
-
-                    /**
-                     * Sets the overwrite lazy object, invalidating the increment lazy object.
-                     */
-                    void set_overwrite_lazy(Item const & lazy) {
-                        overwrite_lazy = lazy;
-                        has_overwrite_lazy = true;
-
-                        increment_lazy = 0;
-                        has_increment_lazy = false;
-                    }
-
-                    /**
-                     * Adds to the increment lazy object.
-                     */
-                    void add_increment_lazy(Item const & lazy) {
-                        increment_lazy += lazy;
-                        has_increment_lazy = true;
-                    }
-
-                    /**
-                     * Resets the lazy objects back to zero.
-                     */
-                    void reset_lazy() {
-                        overwrite_lazy = 0;
-                        has_overwrite_lazy = false;
+                        Lazy() {}
+                };
 
-                        increment_lazy = 0;
-                        has_increment_lazy = false;
-                    }
+                /**
+                 * A range of the elements, on which the lazy objects are to be applied.
+                 */
+                struct CoalescedUpdate {
+                    size_t l;
+                    size_t r;
+                    Lazy lazy;
+
+                    CoalescedUpdate(size_t ll, size_t rr, Lazy const & llazy) :
+                        l(ll),
+                        r(rr),
+                        lazy(llazy) {}
                 };
 
                 UpdatableNode * cast(Node * n) {
@@ -87,124 +118,228 @@ namespace gokul2411s {
                 }
 
                 /**
-                 * Applies overwrite on the node based on the given value and sets the node's lazy accordingly.
+                 * Called on every node that an update changes, be it the value or the lazy
+                 * objects. Derived may hide this to track the changed nodes, e.g. for incremental
+                 * checkpoints.
+                 */
+                void mark_dirty(UpdatableNode *) {}
+
+                /**
+                 * Applies the lazy objects on the node, and sets the node's lazy accordingly.
                  */
-                void apply_overwrite_and_lazy(UpdatableNode * n, Item const & val) {
-                    apply_overwrite(n, val);
+                void apply_lazy(UpdatableNode * n, Lazy const & lazy) {
+                    this->derived().mark_dirty(n);
+                    n->val = lazy.apply(n->val, n->start, n->end, this->aggregator_);
                     if (n->non_trivial()) {
-                        n->set_overwrite_lazy(val);
+                        n->compose(lazy);
                     }
                 }
 
                 /**
-                 * Applies increment on the node based on the given value and sets the node's lazy accordingly.
+                 * Applies any lazy objects from the given node to its children, if any. This also
+                 * propagates the lazy objects to the children.
                  */
-                void apply_increment_and_lazy(UpdatableNode * n, Item const & val) {
-                    apply_increment(n, val);
-                    if (n->non_trivial()) {
-                        n->add_increment_lazy(val);
+                void propagate_lazy(UpdatableNode * n) {
+                    if (!n->non_trivial() || n->empty()) {
+                        return;
                     }
+
+                    apply_lazy(cast(this->derived().get_left_child(n)), *n);
+                    apply_lazy(cast(this->derived().get_right_child(n)), *n);
+                    this->derived().mark_dirty(n);
+                    static_cast<Lazy &>(*n) = Lazy();
                 }
 
                 /**
-                 * Gets the update that would be applied on the node.
+                 * Recursively applies the lazy objects on the segment tree under the node,
+                 * for any overlap it may have with the closed range [l, r].
                  */
-                Aggregate get_update_value(UpdatableNode const * n, Item const & val) const {
-                    return this->aggregate_times(val, n->end - n->start + 1);
+                void update(size_t l, size_t r, Lazy const & lazy, UpdatableNode * n) {
+                    if (n->outside_range(l, r)) {
+                        return; // noop
+                    }
+
+                    propagate_lazy(n);
+
+                    if (n->within_range(l, r)) {
+                        apply_lazy(n, lazy);
+                    } else {
+                        // node is non-trivial
+                        UpdatableNode * ln = cast(this->derived().get_left_child(n));
+                        UpdatableNode * rn = cast(this->derived().get_right_child(n));
+                        update(l, r, lazy, ln);
+                        update(l, r, lazy, rn);
+                        this->derived().mark_dirty(n);
+                        n->val = this->aggregate(ln->val, rn->val);
+                    }
                 }
 
                 /**
-                 * Applies overwrite on the node based on the given value.
+                 * Gets the value of the node, once the lazy objects pending on it from its
+                 * ancestors are applied. This is how a query reads a node without propagating
+                 * any lazy objects, so that queries leave the tree unchanged.
                  */
-                void apply_overwrite(UpdatableNode * n, Item const & val) {
-                    n->val = get_update_value(n, val);
+                Aggregate get_value(Node const * n, Lazy const & pending) const {
+                    return pending.apply(n->val, n->start, n->end, this->aggregator_);
                 }
 
                 /**
-                 * Applies increment on the node based on the given value.
+                 * Gets the lazy objects pending on the children of the node, which are its own
+                 * lazy objects followed by those pending on it from its ancestors.
                  */
-                void apply_increment(UpdatableNode * n, Item const & val) {
-                    n->val += get_update_value(n, val);
+                Lazy get_children_pending_lazy(Node const * n, Lazy const & pending) const {
+                    Lazy children_pending = *static_cast<UpdatableNode const *>(n);
+                    children_pending.compose(pending);
+                    return children_pending;
                 }
 
                 /**
-                 * Applies any lazy objects from the given node to its children, if any. This also
-                 * propagates the lazy objects to the children.
+                 * Recursively composes the lazy objects into those of the elementary ranges
+                 * numbered within the closed range [l, r], in a tree of lazy objects where the node
+                 * at the index spans the elementary ranges numbered within [lo, hi].
                  */
-                void propagate_lazy(UpdatableNode * n) {
-                    if (!n->non_trivial()) {
-                        return;
+                void compose_range(std::vector<Lazy> & lazies, size_t index, size_t lo, size_t hi, size_t l, size_t r, Lazy const & lazy) {
+                    if (lo > r || hi < l) {
+                        return; // noop
                     }
 
-                    UpdatableNode * ln = cast(this->get_left_child(n));
-                    UpdatableNode * rn = cast(this->get_right_child(n));
-                    if (n->has_overwrite_lazy) {
-                        apply_overwrite_and_lazy(ln, n->overwrite_lazy);
-                        apply_overwrite_and_lazy(rn, n->overwrite_lazy);
+                    if (lo >= l && hi <= r) {
+                        lazies[index].compose(lazy);
+                        return;
                     }
 
-                    if (n->has_increment_lazy) {
-                        apply_increment_and_lazy(ln, n->increment_lazy); 
-                        apply_increment_and_lazy(rn, n->increment_lazy); 
+                    lazies[2 * index + 1].compose(lazies[index]);
+                    lazies[2 * index + 2].compose(lazies[index]);
+                    lazies[index] = Lazy();
+
+                    size_t mid = lo + (hi - lo) / 2;
+                    compose_range(lazies, 2 * index + 1, lo, mid, l, r, lazy);
+                    compose_range(lazies, 2 * index + 2, mid + 1, hi, l, r, lazy);
+                }
+
+                /**
+                 * Recursively collects the combined lazy objects of every elementary range under
+                 * the node at the index of a tree of lazy objects.
+                 */
+                void collect_lazies(std::vector<Lazy> & lazies, size_t index, size_t lo, size_t hi, std::vector<Lazy> & collected) {
+                    if (lo == hi) {
+                        collected[lo] = lazies[index];
+                        return;
                     }
 
-                    n->reset_lazy();
+                    lazies[2 * index + 1].compose(lazies[index]);
+                    lazies[2 * index + 2].compose(lazies[index]);
+
+                    size_t mid = lo + (hi - lo) / 2;
+                    collect_lazies(lazies, 2 * index + 1, lo, mid, collected);
+                    collect_lazies(lazies, 2 * index + 2, mid + 1, hi, collected);
                 }
 
                 /**
-                 * Recursively updates (overwrites or increments as specified by the update type)
-                 * the segment tree using the given value under the node,
-                 * for any overlap it may have with the closed range [l, r]. 
+                 * Coalesces the updates into disjoint ranges in increasing order, each carrying the
+                 * combined effect of the updates on it. The endpoints of the updates cut the
+                 * elements into elementary ranges, on which the updates are composed in order with
+                 * a small tree of lazy objects, and neighbouring elementary ranges with the same
+                 * combined effect are merged.
                  */
-                void update(size_t l, size_t r, Item const & val, UpdatableNode * n, UpdateType update_type) {
-                    if (n->outside_range(l, r)) {
-                        return; // noop
+                void coalesce(std::vector<RangeUpdate> const & updates, std::vector<CoalescedUpdate> & coalesced) {
+                    if (updates.empty()) {
+                        return;
                     }
 
-                    propagate_lazy(n);
+                    // elementary range j is the closed range [bounds[j], bounds[j + 1] - 1].
+                    std::vector<size_t> bounds;
+                    for (typename std::vector<RangeUpdate>::const_iterator it = updates.begin(); it != updates.end(); it++) {
+                        bounds.push_back(it->l);
+                        bounds.push_back(it->r + 1);
+                    }
+                    std::sort(bounds.begin(), bounds.end());
+                    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+                    size_t num_ranges = bounds.size() - 1;
+                    std::vector<Lazy> lazies(4 * num_ranges);
+                    for (typename std::vector<RangeUpdate>::const_iterator it = updates.begin(); it != updates.end(); it++) {
+                        size_t l = std::lower_bound(bounds.begin(), bounds.end(), it->l) - bounds.begin();
+                        size_t r = std::lower_bound(bounds.begin(), bounds.end(), it->r + 1) - bounds.begin() - 1;
+                        compose_range(lazies, 0, 0, num_ranges - 1, l, r, it->lazy);
+                    }
 
-                    if (n->within_range(l, r)) {
-                        // prefer if loop over function pointers, since most users will either call one of either increment
-                        // or update most of the time, and the processor will be able to guess well. function pointers will
-                        // also screw up with the compiler's optimization mechanisms.
-                        if (update_type == OVERWRITE) {
-                            apply_overwrite_and_lazy(n, val);
+                    std::vector<Lazy> collected(num_ranges);
+                    collect_lazies(lazies, 0, 0, num_ranges - 1, collected);
+                    for (size_t j = 0; j < num_ranges; j++) {
+                        if (collected[j].empty()) {
+                            continue;
+                        }
+
+                        if (!coalesced.empty() && coalesced.back().r + 1 == bounds[j] && coalesced.back().lazy == collected[j]) {
+                            coalesced.back().r = bounds[j + 1] - 1;
                         } else {
-                            apply_increment_and_lazy(n, val);
+                            coalesced.push_back(CoalescedUpdate(bounds[j], bounds[j + 1] - 1, collected[j]));
                         }
-                    } else {
-                        // node is non-trivial
-                        UpdatableNode * ln = cast(this->get_left_child(n));
-                        UpdatableNode * rn = cast(this->get_right_child(n));
-                        update(l, r, val, ln, update_type);
-                        update(l, r, val, rn, update_type);
-                        n->val = this->aggregate(ln->val, rn->val);
                     }
                 }
-                
-                virtual Aggregate query_impl(size_t l, size_t r, Node * n) {
-                    if (n->outside_range(l, r)) {
-                        return this->aggregator_null();
+
+                /**
+                 * Recursively applies the coalesced updates numbered within [lo, hi), which are
+                 * exactly the ones overlapping the node, to the segment tree under the node.
+                 */
+                void update_batch(UpdatableNode * n, std::vector<CoalescedUpdate> const & coalesced, size_t lo, size_t hi) {
+                    if (lo == hi) {
+                        return; // noop
+                    }
+
+                    if (hi - lo == 1 && n->within_range(coalesced[lo].l, coalesced[lo].r)) {
+                        apply_lazy(n, coalesced[lo].lazy);
+                        return;
                     }
 
-                    propagate_lazy(cast(n));
+                    // node is non-trivial, since the coalesced updates are disjoint.
+                    propagate_lazy(n);
+                    UpdatableNode * ln = cast(this->derived().get_left_child(n));
+                    UpdatableNode * rn = cast(this->derived().get_right_child(n));
 
-                    if (n->within_range(l, r)) {
-                        return n->val;
-                    } else {
-                        return this->aggregate(query_impl(l, r, this->get_left_child(n)), query_impl(l, r, this->get_right_child(n)));
+                    size_t lhi = lo;
+                    while (lhi < hi && coalesced[lhi].l <= ln->end) {
+                        lhi++;
+                    }
+
+                    // an update straddling the children goes to both of them.
+                    size_t rlo = lhi;
+                    if (rlo > lo && coalesced[rlo - 1].r >= rn->start) {
+                        rlo--;
                     }
+
+                    update_batch(ln, coalesced, lo, lhi);
+                    update_batch(rn, coalesced, rlo, hi);
+                    this->derived().mark_dirty(n);
+                    n->val = this->aggregate(ln->val, rn->val);
                 }
         };
 
+    UpdatableSegtreeTmplParamSpec
+        void UpdatableSegtreeTmpl::update(size_t l, size_t r, Lazy const & lazy) {
+            update(l, r, lazy, cast(this->root_));
+        }
+
     UpdatableSegtreeTmplParamSpec 
         void UpdatableSegtreeTmpl::overwrite(size_t l, size_t r, Item const & val) {
-            update(l, r, val, cast(this->root_), OVERWRITE);
+            Lazy lazy;
+            lazy.set_overwrite_lazy(val);
+            update(l, r, lazy, cast(this->root_));
         }
 
     UpdatableSegtreeTmplParamSpec    
         void UpdatableSegtreeTmpl::increment(size_t l, size_t r, Item const & val) {
-            update(l, r, val, cast(this->root_), INCREMENT);
+            Lazy lazy;
+            lazy.add_increment_lazy(val);
+            update(l, r, lazy, cast(this->root_));
+        }
+
+    UpdatableSegtreeTmplParamSpec
+        void UpdatableSegtreeTmpl::apply_batch(std::vector<RangeUpdate> const & updates) {
+            std::vector<CoalescedUpdate> coalesced;
+            coalesce(updates, coalesced);
+            update_batch(cast(this->root_), coalesced, 0, coalesced.size());
         }
 }
 
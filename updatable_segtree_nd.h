@@ -3,21 +3,17 @@
 
 #include <stdlib.h>
 
+#include "segtree_lazy.h"
 #include "segtree_nd.h"
 
-#define UpdatableSegtreeNdTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
-#define UpdatableSegtreeNdTmpl UpdatableSegtreeNd<Item, Aggregate, Aggregator, Point, NumDims>
-#define SegtreeNdTmpl SegtreeNd<Aggregate, Aggregator, Point, NumDims>
+#define UpdatableSegtreeNdTmplParamSpec template<typename Derived, typename Item, typename Aggregate, typename Aggregator, typename Point, size_t NumDims>
+#define UpdatableSegtreeNdTmpl UpdatableSegtreeNd<Derived, Item, Aggregate, Aggregator, Point, NumDims>
+#define SegtreeNdTmpl SegtreeNd<Derived, Aggregate, Aggregator, Point, NumDims>
 
 namespace gokul2411s {
     UpdatableSegtreeNdTmplParamSpec
         class UpdatableSegtreeNd : public SegtreeNdTmpl {
             public:
-                UpdatableSegtreeNd(Aggregator const & aggregator) :
-                    SegtreeNdTmpl(aggregator) {}
-
-                virtual ~UpdatableSegtreeNd() {}
-
                 /**
                  * Overwrites all elements of the closed range [l, r] with the given value.
                  */
@@ -28,58 +24,22 @@ namespace gokul2411s {
                  */
                 void increment(Point const & l, Point const & r, Item const & val);
             protected:
-                enum UpdateType {
-                    OVERWRITE,
-                    INCREMENT
-                };
+                typedef UpdateLazy<Item> Lazy;
+
+                UpdatableSegtreeNd(Aggregator const & aggregator) :
+                    SegtreeNdTmpl(aggregator) {}
+
+                ~UpdatableSegtreeNd() {}
 
                 using typename SegtreeNdTmpl::Node;
                 /**
-                 * Wraps the Node object with two objects, one for overwrite updates and another for
-                 * increment updates that are used to propagate updates to children nodes lazily.
+                 * Wraps the Node object with the lazy objects that are used to propagate updates
+                 * to children nodes lazily.
                  */
-                struct UpdatableNode : public Node {
-                    Item overwrite_lazy; 
-                    Item increment_lazy;
-                    bool has_overwrite_lazy;
-                    bool has_increment_lazy;
-
+                struct UpdatableNode : public Node, public Lazy {
                     UpdatableNode(Aggregate const & val, Point const & start, Point const & end) :
                         Node(val, start, end),
-                        overwrite_lazy(0),
-                        increment_lazy(0),
-                        has_overwrite_lazy(false),
-                        has_increment_lazy(false) {}
-
-                    /**
-                     * Sets the overwrite lazy object, invalidating the increment lazy object.
-                     */
-                    void set_overwrite_lazy(Item const & lazy) {
-                        overwrite_lazy = lazy;
-                        has_overwrite_lazy = true;
-
-                        increment_lazy = 0;
-                        has_increment_lazy = false;
-                    }
-
-                    /**
-                     * Adds to the increment lazy object.
-                     */
-                    void add_increment_lazy(Item const & lazy) {
-                        increment_lazy += lazy;
-                        has_increment_lazy = true;
-                    }
-
-                    /**
-                     * Resets the lazy objects back to zero.
-                     */
-                    void reset_lazy() {
-                        overwrite_lazy = 0;
-                        has_overwrite_lazy = false;
-
-                        increment_lazy = 0;
-                        has_increment_lazy = false;
-                    }
+                        Lazy() {}
                 };
 
                 UpdatableNode * cast(Node * n) {
@@ -87,84 +47,40 @@ namespace gokul2411s {
                 }
 
                 /**
-                 * Applies overwrite on the node based on the given value and sets the node's lazy accordingly.
+                 * Applies the lazy objects on the node, and keeps them pending for its children.
+                 * UpdateLazy only needs the number of elements of the node, so they are passed as
+                 * a flat range.
                  */
-                void apply_overwrite_and_lazy(UpdatableNode * n, Item const & val) {
-                    apply_overwrite(n, val);
+                void apply_lazy(UpdatableNode * n, Lazy const & lazy) {
+                    n->val = lazy.apply(n->val, 0, n->size() - 1, this->aggregator_);
                     if (n->non_trivial()) {
-                        n->set_overwrite_lazy(val);
+                        n->compose(lazy);
                     }
                 }
 
-                /**
-                 * Applies increment on the node based on the given value and sets the node's lazy accordingly.
-                 */
-                void apply_increment_and_lazy(UpdatableNode * n, Item const & val) {
-                    apply_increment(n, val);
-                    if (n->non_trivial()) {
-                        n->add_increment_lazy(val);
-                    }
-                }
-
-                /**
-                 * Gets the update that would be applied on the node.
-                 */
-                Aggregate get_update_value(UpdatableNode const * n, Item const & val) const {
-                    return this->aggregate_times(val, n->size());
-                }
-
-                /**
-                 * Applies overwrite on the node based on the given value.
-                 */
-                void apply_overwrite(UpdatableNode * n, Item const & val) {
-                    n->val = get_update_value(n, val);
-                }
-
-                /**
-                 * Applies increment on the node based on the given value.
-                 */
-                void apply_increment(UpdatableNode * n, Item const & val) {
-                    n->val += get_update_value(n, val);
-                }
-
                 /**
                  * Applies any lazy objects from the given node to its children, if any. This also
                  * propagates the lazy objects to the children.
                  */
                 void propagate_lazy(UpdatableNode * n) {
-                    if (!n->non_trivial()) {
+                    if (!n->non_trivial() || n->empty()) {
                         return;
                     }
 
-                    if (n->has_overwrite_lazy) {
-                        for (size_t k = 0; k < SegtreeNdTmpl::NUM_CHILDREN; k++) {
-                            UpdatableNode * child_node = cast(this->get_child_node(n, k));
-                            if (child_node == NULL) {
-                                break;
-                            }
-                            apply_overwrite_and_lazy(child_node, n->overwrite_lazy);
-                        }
+                    Node * children[SegtreeNdTmpl::NUM_CHILDREN];
+                    size_t num_children = this->get_children(n, children);
+                    for (size_t k = 0; k < num_children; k++) {
+                        apply_lazy(cast(children[k]), *n);
                     }
 
-                    if (n->has_increment_lazy) {
-                        for (size_t k = 0; k < SegtreeNdTmpl::NUM_CHILDREN; k++) {
-                            UpdatableNode * child_node = cast(this->get_child_node(n, k));
-                            if (child_node == NULL) {
-                                break;
-                            }
-                            apply_increment_and_lazy(child_node, n->increment_lazy); 
-                        }
-                    }
-
-                    n->reset_lazy();
+                    static_cast<Lazy &>(*n) = Lazy();
                 }
 
                 /**
-                 * Recursively updates (overwrites or increments as specified by the update type)
-                 * the segment tree using the given value under the node,
-                 * for any overlap it may have with the closed range [l, r]. 
+                 * Recursively applies the lazy objects on the segment tree under the node,
+                 * for any overlap it may have with the closed range [l, r].
                  */
-                void update(Point const & l, Point const & r, Item const & val, UpdatableNode * n, UpdateType update_type) {
+                void update(Point const & l, Point const & r, Lazy const & lazy, UpdatableNode * n) {
                     if (n->outside_range(l, r)) {
                         return; // noop
                     }
@@ -172,35 +88,27 @@ namespace gokul2411s {
                     propagate_lazy(n);
 
                     if (n->within_range(l, r)) {
-                        // prefer if loop over function pointers, since most users will either call one of either increment
-                        // or update most of the time, and the processor will be able to guess well. function pointers will
-                        // also screw up with the compiler's optimization mechanisms.
-                        if (update_type == OVERWRITE) {
-                            apply_overwrite_and_lazy(n, val);
-                        } else {
-                            apply_increment_and_lazy(n, val);
-                        }
+                        apply_lazy(n, lazy);
                     } else {
                         // node is non-trivial
-                        for (size_t k = 0; k < SegtreeNdTmpl::NUM_CHILDREN; k++) {
-                            UpdatableNode * child_node = cast(this->get_child_node(n, k));
-                            if (child_node == NULL) {
-                                break;
-                            }
-                            update(l, r, val, child_node, update_type);
+                        Node * children[SegtreeNdTmpl::NUM_CHILDREN];
+                        size_t num_children = this->get_children(n, children);
+                        Aggregate val_from_children = this->aggregator_null();
+                        for (size_t k = 0; k < num_children; k++) {
+                            update(l, r, lazy, cast(children[k]));
+                            val_from_children = this->aggregate(val_from_children, children[k]->val);
                         }
-                        n->val = this->get_children_aggregate(n);
+                        n->val = val_from_children;
                     }
                 }
                 
-                virtual Aggregate query_impl(Point const & l, Point const & r, Node * n) {
+                Aggregate query_impl(Point const & l, Point const & r, Node * n) {
                     if (n->outside_range(l, r)) {
                         return this->aggregator_null();
                     }
 
                     propagate_lazy(cast(n));
                     
-                    Aggregate ret;
                     if (n->within_range(l, r)) {
                         return n->val;
                     } else {
@@ -211,12 +119,16 @@ namespace gokul2411s {
 
     UpdatableSegtreeNdTmplParamSpec 
         void UpdatableSegtreeNdTmpl::overwrite(Point const & l, Point const & r, Item const & val) {
-            update(l, r, val, cast(this->root_), OVERWRITE);
+            Lazy lazy;
+            lazy.set_overwrite_lazy(val);
+            update(l, r, lazy, cast(this->root_));
         }
 
     UpdatableSegtreeNdTmplParamSpec    
         void UpdatableSegtreeNdTmpl::increment(Point const & l, Point const & r, Item const & val) {
-            update(l, r, val, cast(this->root_), INCREMENT);
+            Lazy lazy;
+            lazy.add_increment_lazy(val);
+            update(l, r, lazy, cast(this->root_));
         }
 }
 
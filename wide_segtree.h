@@ -0,0 +1,221 @@
+#ifndef WIDE_SEGTREE_H_
+#define WIDE_SEGTREE_H_
+
+#include <new>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+#define WideSegtreeTmplParamSpec template<typename Item, typename Aggregate, typename Aggregator, size_t Fanout>
+#define WideSegtreeTmpl WideSegtree<Item, Aggregate, Aggregator, Fanout>
+
+namespace gokul2411s {
+    /**
+     * A static segment tree in which every node has Fanout children, whose aggregates are
+     * packed next to each other. The tree is log2(Fanout) times shorter than a binary one, so a
+     * query makes that many times fewer dependent memory accesses, and the children of a node
+     * are scanned with a plain loop over one or two cache lines, which the compiler can
+     * vectorize for simple aggregators. The elements cannot be updated once the tree is built.
+     *
+     * The tree is stored bottom-up as levels, from the elements to the root, one after another
+     * in a single buffer aligned to a cache line. Every level is padded with null elements to a
+     * multiple of Fanout, so the children of the entry j of a level are the entries jF to
+     * jF + F - 1 of the level below, and start on a cache line whenever Fanout aggregates fill
+     * whole cache lines.
+     */
+    template<typename Item, typename Aggregate, typename Aggregator, size_t Fanout = 16>
+        class WideSegtree {
+            public:
+                template<typename Iterator> WideSegtree(Iterator begin, Iterator end, Aggregator const & aggregator = Aggregator());
+                ~WideSegtree();
+
+                /**
+                 * Returns the aggregated result in the closed range [l, r].
+                 */
+                Aggregate query(size_t l, size_t r) const;
+
+                /**
+                 * Returns the smallest index i for which pred holds on the aggregate of the closed
+                 * range [0, i], or the number of elements if there is none. pred must be monotone
+                 * over the prefixes, i.e. once it holds on a prefix, it holds on all longer ones.
+                 */
+                template<typename Predicate> size_t prefix_search(Predicate const & pred) const;
+            protected:
+                static const size_t CACHE_LINE_SIZE = 64;
+
+                Aggregator aggregator_;
+                size_t size_;
+
+                // the index of the first entry of each level in the buffer, from the elements up
+                // to the root, followed by the total number of entries.
+                std::vector<size_t> level_offsets_;
+
+                char * buffer_;
+                Aggregate * entries_;
+
+                /**
+                 * Wraps the null method provided by the aggregator.
+                 */
+                Aggregate aggregator_null() const {
+                    return aggregator_.null();
+                }
+
+                /**
+                 * Wraps the two-element aggregation method provided by the aggregator.
+                 */
+                Aggregate aggregate(Aggregate const & a, Aggregate const & b) const {
+                    return aggregator_.aggregate(a, b);
+                }
+
+                /**
+                 * Gets the number of levels in the tree.
+                 */
+                size_t get_num_levels() const {
+                    return level_offsets_.size() - 1;
+                }
+
+                /**
+                 * Gets the entries of the given level.
+                 */
+                Aggregate const * get_level(size_t level) const {
+                    return entries_ + level_offsets_[level];
+                }
+
+                /**
+                 * Aggregates the entries lo to hi of a level, which lie within the children of
+                 * one node.
+                 */
+                Aggregate reduce(Aggregate const * entries, size_t lo, size_t hi) const {
+                    Aggregate ret = aggregator_null();
+                    for (size_t i = lo; i <= hi; i++) {
+                        ret = aggregate(ret, entries[i]);
+                    }
+                    return ret;
+                }
+
+            private:
+                WideSegtree(WideSegtree const &);
+                WideSegtree & operator = (WideSegtree const &);
+        };
+
+    WideSegtreeTmplParamSpec
+        template<typename Iterator> WideSegtreeTmpl::WideSegtree(Iterator begin, Iterator end, Aggregator const & aggregator)
+        : aggregator_(aggregator), size_(end - begin) {
+            size_t total = 0;
+            for (size_t num_entries = size_; ; num_entries = (num_entries + Fanout - 1) / Fanout) {
+                level_offsets_.push_back(total);
+                total += (num_entries + Fanout - 1) / Fanout * Fanout;
+                if (num_entries <= 1) {
+                    break;
+                }
+            }
+            level_offsets_.push_back(total);
+
+            buffer_ = (char *)malloc(total * sizeof(Aggregate) + CACHE_LINE_SIZE);
+            entries_ = (Aggregate *)(buffer_ + CACHE_LINE_SIZE - (size_t)buffer_ % CACHE_LINE_SIZE);
+
+            Aggregate * elements = entries_;
+            for (size_t i = 0; i < size_; i++, ++begin) {
+                new (elements + i) Aggregate(*begin);
+            }
+
+            for (size_t level = 0; level < get_num_levels(); level++) {
+                Aggregate * entries = entries_ + level_offsets_[level];
+                size_t padded = level_offsets_[level + 1] - level_offsets_[level];
+                size_t num_entries = level == 0 ? size_ : (level_offsets_[level] - level_offsets_[level - 1]) / Fanout;
+                for (size_t i = level == 0 ? size_ : num_entries; i < padded; i++) {
+                    new (entries + i) Aggregate(aggregator_null());
+                }
+
+                if (level + 1 < get_num_levels()) {
+                    Aggregate * parents = entries_ + level_offsets_[level + 1];
+                    for (size_t j = 0; j < padded / Fanout; j++) {
+                        new (parents + j) Aggregate(reduce(entries, j * Fanout, j * Fanout + Fanout - 1));
+                    }
+                }
+            }
+        }
+
+    WideSegtreeTmplParamSpec
+        WideSegtreeTmpl::~WideSegtree() {
+            for (size_t i = 0; i < level_offsets_.back(); i++) {
+                entries_[i].~Aggregate();
+            }
+            free(buffer_);
+        }
+
+    WideSegtreeTmplParamSpec
+        Aggregate WideSegtreeTmpl::query(size_t l, size_t r) const {
+            // keep the left and right contributions apart, so that the order of aggregation
+            // is preserved for non-commutative aggregators.
+            Aggregate lres = aggregator_null(), rres = aggregator_null();
+            for (size_t level = 0; ; level++) {
+                Aggregate const * entries = get_level(level);
+                if (l / Fanout == r / Fanout) {
+                    if (l % Fanout == 0 && r % Fanout == Fanout - 1 && level + 1 < get_num_levels()) {
+                        l /= Fanout;
+                        r /= Fanout;
+                        continue;
+                    }
+
+                    lres = aggregate(lres, reduce(entries, l, r));
+                    break;
+                }
+
+                // the children of the nodes at the ends of the range are taken here only if the
+                // range covers them partially; otherwise the nodes are taken one level up.
+                if (l % Fanout != 0) {
+                    lres = aggregate(lres, reduce(entries, l, l - l % Fanout + Fanout - 1));
+                    l = l / Fanout + 1;
+                } else {
+                    l = l / Fanout;
+                }
+
+                if (r % Fanout != Fanout - 1) {
+                    rres = aggregate(reduce(entries, r - r % Fanout, r), rres);
+                    r = r / Fanout - 1;
+                } else {
+                    r = r / Fanout;
+                }
+
+                if (l > r) {
+                    break;
+                }
+            }
+
+            return aggregate(lres, rres);
+        }
+
+    WideSegtreeTmplParamSpec
+        template<typename Predicate> size_t WideSegtreeTmpl::prefix_search(Predicate const & pred) const {
+            size_t top = get_num_levels() - 1;
+            if (!pred(get_level(top)[0])) {
+                return size_;
+            }
+
+            // descend into the first child whose prefix satisfies pred, carrying the aggregate
+            // of everything to its left.
+            Aggregate acc = aggregator_null();
+            size_t index = 0;
+            for (size_t level = top; level-- > 0;) {
+                Aggregate const * entries = get_level(level);
+                size_t child = index * Fanout, last = child + Fanout - 1;
+                for (; child <= last; child++) {
+                    Aggregate candidate = aggregate(acc, entries[child]);
+                    if (pred(candidate)) {
+                        break;
+                    }
+                    acc = candidate;
+                }
+
+                if (child > last) {
+                    return size_; // pred is not monotone
+                }
+                index = child;
+            }
+            return index;
+        }
+}
+
+#endif